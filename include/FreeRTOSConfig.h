@@ -102,15 +102,40 @@ turn the tick off. */
 #define configUSE_TASK_NOTIFICATIONS            1
 
 /* Memory allocation related definitions. */
-#define configSUPPORT_STATIC_ALLOCATION         0    // change from 0
+// make STATIC_ALLOCATION=1 -- tasks, queues and drivers live in static storage, see task_table.hpp
+#ifndef STATIC_ALLOCATION
+#define STATIC_ALLOCATION                       0
+#endif
+// With STATIC_ALLOCATION, whether heap_4 may still be used once the scheduler has started
+#ifndef HEAP_AFTER_STARTUP
+#define HEAP_AFTER_STARTUP                      1
+#endif
+
+#define configSUPPORT_STATIC_ALLOCATION         STATIC_ALLOCATION
 #define configSUPPORT_DYNAMIC_ALLOCATION        1
 #define configTOTAL_HEAP_SIZE                   ( ( size_t ) ( 60 * 1024 ) )
 
+#if STATIC_ALLOCATION
+// Checks every heap_4 allocation against the policy above
+#ifdef __cplusplus
+extern "C" {
+#endif
+void vApplicationHeapAllocationHook( void* pvAddress, size_t uiSize );
+#ifdef __cplusplus
+}
+#endif
+#define traceMALLOC( pvAddress, uiSize ) vApplicationHeapAllocationHook( pvAddress, uiSize )
+#endif
+
 /* Hook function related definitions. */
 #define configUSE_IDLE_HOOK                     1
 #define configUSE_TICK_HOOK                     0  // change from 1
-#define configCHECK_FOR_STACK_OVERFLOW          1
-#define configUSE_MALLOC_FAILED_HOOK            0    // change from 1
+#define configCHECK_FOR_STACK_OVERFLOW          2    // also checks the pattern at the end of the stack
+#define configUSE_MALLOC_FAILED_HOOK            1
+// make RESET_ON_MALLOC_FAILED=1 -- the hook resets instead of only recording the failure
+#ifndef RESET_ON_MALLOC_FAILED
+#define RESET_ON_MALLOC_FAILED                  0
+#endif
 
 /* Run time stats gathering definitions. */
 extern volatile uint32_t _freertos_stats_base_ticks;
@@ -0,0 +1,190 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Drop in replacement for std::function that never allocates. The callable is stored
+// inside the object itself; a callable (lambda captures included) that does not fit in
+// Capacity bytes is a compile error rather than a trip to the heap.
+template <typename Signature, size_t Capacity = 16>
+class InplaceFunction;
+
+template <typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+{
+	// One of these exists per stored callable type
+	struct Operations
+	{
+		R (*invoke)(void* storage, Args&&... args);
+		void (*copy)(void* dst, const void* src);
+		void (*move)(void* dst, void* src);
+		void (*destroy)(void* storage);
+	};
+
+	template <typename Functor>
+	struct OperationsFor
+	{
+		static R invoke(void* storage, Args&&... args)
+		{
+			return (*static_cast<Functor*>(storage))(std::forward<Args>(args)...);
+		}
+
+		static void copy(void* dst, const void* src)
+		{
+			new (dst) Functor(*static_cast<const Functor*>(src));
+		}
+
+		static void move(void* dst, void* src)
+		{
+			new (dst) Functor(std::move(*static_cast<Functor*>(src)));
+		}
+
+		static void destroy(void* storage)
+		{
+			static_cast<Functor*>(storage)->~Functor();
+		}
+
+		static constexpr Operations operations = { &invoke, &copy, &move, &destroy };
+	};
+
+	template <typename Functor>
+	using EnableIfCallable = typename std::enable_if<
+		!std::is_same<typename std::decay<Functor>::type, InplaceFunction>::value &&
+		!std::is_same<typename std::decay<Functor>::type, std::nullptr_t>::value>::type;
+
+public:
+	InplaceFunction() = default;
+
+	InplaceFunction(std::nullptr_t) {}
+
+	template <typename Functor, typename = EnableIfCallable<Functor>>
+	InplaceFunction(Functor&& f)
+	{
+		using Callable = typename std::decay<Functor>::type;
+
+		static_assert(sizeof(Callable) <= Capacity, "callable is too large for InplaceFunction -- capture less or raise Capacity");
+		static_assert(alignof(Callable) <= alignof(std::max_align_t), "callable is over aligned for InplaceFunction");
+
+		new (&_storage) Callable(std::forward<Functor>(f));
+		_operations = &OperationsFor<Callable>::operations;
+	}
+
+	InplaceFunction(const InplaceFunction& other)
+	{
+		if (other._operations != nullptr)
+		{
+			other._operations->copy(&_storage, &other._storage);
+			_operations = other._operations;
+		}
+	}
+
+	InplaceFunction(InplaceFunction&& other)
+	{
+		if (other._operations != nullptr)
+		{
+			other._operations->move(&_storage, &other._storage);
+			_operations = other._operations;
+			other.reset();
+		}
+	}
+
+	~InplaceFunction()
+	{
+		reset();
+	}
+
+	InplaceFunction& operator=(const InplaceFunction& other)
+	{
+		if (this != &other)
+		{
+			reset();
+
+			if (other._operations != nullptr)
+			{
+				other._operations->copy(&_storage, &other._storage);
+				_operations = other._operations;
+			}
+		}
+
+		return *this;
+	}
+
+	InplaceFunction& operator=(InplaceFunction&& other)
+	{
+		if (this != &other)
+		{
+			reset();
+
+			if (other._operations != nullptr)
+			{
+				other._operations->move(&_storage, &other._storage);
+				_operations = other._operations;
+				other.reset();
+			}
+		}
+
+		return *this;
+	}
+
+	InplaceFunction& operator=(std::nullptr_t)
+	{
+		reset();
+		return *this;
+	}
+
+	template <typename Functor, typename = EnableIfCallable<Functor>>
+	InplaceFunction& operator=(Functor&& f)
+	{
+		return *this = InplaceFunction(std::forward<Functor>(f));
+	}
+
+	// Calling an empty InplaceFunction is undefined -- check it first
+	R operator()(Args... args) const
+	{
+		return _operations->invoke(&_storage, std::forward<Args>(args)...);
+	}
+
+	explicit operator bool() const { return _operations != nullptr; };
+
+private:
+	void reset(void)
+	{
+		if (_operations != nullptr)
+		{
+			_operations->destroy(&_storage);
+			_operations = nullptr;
+		}
+	}
+
+	mutable typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type _storage;
+	const Operations* _operations = nullptr;
+};
+
+template <typename R, typename... Args, size_t Capacity>
+template <typename Functor>
+constexpr typename InplaceFunction<R(Args...), Capacity>::Operations
+	InplaceFunction<R(Args...), Capacity>::OperationsFor<Functor>::operations;
@@ -22,190 +22,670 @@
 
 #pragma once
 
-#include <vector>
 #include <string>
 #include <atomic>
 
 #include <timers/Time.hpp>
 
-// TODO: autogenerate these...
-struct __attribute__((__packed__)) accel_raw_data_s
-{
-	abs_time_t timestamp;
-	float temperature;
-	float x;
-	float y;
-	float z;
-};
+// Topic structs are generated from msg/*.msg at build time
+#include <messages.hpp>
+
+// Every topic is listed here exactly once: X(struct, depth, kind). This gives each
+// topic a constexpr id, sizes the registry at compile time and builds the topic
+// table that the shell lists. COPY topics go through Publisher / Subscriber and
+// their depth is the queue depth, which must be a power of 2. LOAN topics go through
+// LoanedPublisher / LoanedSubscriber and their depth is the size of the slot pool.
+#define MESSENGER_TOPICS(X)				\
+	X(accel_raw_data_s, 1, COPY)		\
+	X(gyro_raw_data_s, 8, COPY)			\
+	X(gyro_filtered_data_s, 1, COPY)	\
+	X(mag_raw_data_s, 1, COPY)			\
+	X(manual_control_s, 1, COPY)		\
+	X(attitude_euler_s, 1, COPY)		\
+	X(rates_control_euler_s, 1, COPY)	\
+	X(setpoint_rates_s, 1, COPY)		\
+	X(setpoint_angle_s, 1, COPY)		\
+	X(memory_status_s, 1, COPY)			\
+	X(gyro_batch_s, 4, COPY)			\
+	X(sensor_calibration_s, 1, COPY)
 
-struct __attribute__((__packed__)) gyro_raw_data_s
+// Multiple publisher multiple subscriber implementation
+// with a (SHARED!) data file.
+//
+// The data file is guarded by a sequence counter (seqlock). A writer bumps the
+// sequence to an odd value, copies the data in and bumps it back to even. Readers
+// copy the data out and retry if the sequence was odd or changed underneath them.
+// Readers never disable interrupts. Writers suspend the scheduler (but not interrupts)
+// so that two publishers can not interleave and a higher priority reader can never
+// spin on a half written file. Reading from an ISR is NOT supported.
+//
+// A topic may queue more than one sample (see MESSENGER_TOPICS). The data file then
+// becomes a ring of N slots and each Subscriber drains it from its own read position,
+// so a slow reader no longer drops samples from a fast publisher.
+//
+// A Subscriber can also register the task that owns it with the TopicRegistry. Every
+// publish then sets the topic's bit in that task's notification value, so it can block
+// in wait_for_update() instead of polling updated() and sleeping a whole tick.
+//
+// Large topics (LOAN in MESSENGER_TOPICS) skip both copies with LoanedPublisher /
+// LoanedSubscriber. The publisher fills a slot of a fixed pool in place and commits it,
+// subscribers get a read-only reference counted Loan of the newest slot. A slot is
+// recycled once the last Loan on it is released. A subscriber only ever sees the newest
+// slot, skipped commits count as missed. The loan_test benchmark has the copy path ahead
+// up to a few KiB (the loan takes the scheduler lock twice), so every topic here is
+// COPY for now and LOAN is left for messages too big to copy at rate.
+namespace messenger
 {
-	abs_time_t timestamp;
-	float temperature;
-	float x;
-	float y;
-	float z;
-};
 
-struct __attribute__((__packed__)) gyro_filtered_data_s
+#define MESSENGER_TOPIC_ID(type, depth, kind) type##_id,
+enum TopicId : uint8_t
 {
-	abs_time_t timestamp;
-	float temperature;
-	float x;
-	float y;
-	float z;
+	MESSENGER_TOPICS(MESSENGER_TOPIC_ID)
+	TOPIC_COUNT
 };
+#undef MESSENGER_TOPIC_ID
 
-struct __attribute__((__packed__)) mag_raw_data_s
-{
-	abs_time_t timestamp;
-	float temperature;
-	float x;
-	float y;
-	float z;
-};
+static_assert(TOPIC_COUNT <= 32, "topic bits must fit in a task notification value");
 
-struct __attribute__((__packed__)) manual_control_s
+enum class TopicKind : uint8_t
 {
-	abs_time_t timestamp;
-	float roll;
-	float pitch;
-	float yaw;
-	float throttle;
-	bool kill_switch;
+	COPY,
+	LOAN,
 };
 
-struct __attribute__((__packed__)) attitude_euler_s
-{
-	abs_time_t timestamp;
-	float roll;
-	float pitch;
-	float yaw;
+// Only topics listed in MESSENGER_TOPICS have traits -- anything else fails to compile
+template <typename T>
+struct topic_traits;
+
+#define MESSENGER_TOPIC_TRAITS(type, queue_depth, topic_kind)	\
+template <>												\
+struct topic_traits<type>								\
+{														\
+	static constexpr TopicId id = type##_id;			\
+	static constexpr size_t depth = queue_depth;		\
+	static constexpr TopicKind kind = TopicKind::topic_kind;	\
+	static constexpr const char* name = #type;			\
 };
+MESSENGER_TOPICS(MESSENGER_TOPIC_TRAITS)
+#undef MESSENGER_TOPIC_TRAITS
 
-struct __attribute__((__packed__)) rates_control_euler_s
+struct TopicInfo
 {
-	abs_time_t timestamp;
-	float roll;
-	float pitch;
-	float yaw;
+	const char* name;
+	size_t size;
+	size_t depth;
+	TopicKind kind;
 };
 
-struct __attribute__((__packed__)) setpoint_rates_s
+// Indexed by TopicId
+extern const TopicInfo TOPIC_TABLE[TOPIC_COUNT];
+
+// Publish rate and subscriber health of a topic. Only the publisher writes the
+// publish fields (with the scheduler suspended); subscribers add to missed.
+struct TopicStats
 {
-	abs_time_t timestamp;
-	float roll;
-	float pitch;
-	float yaw;
+	uint32_t publish_count;
+	abs_time_t last_publish; // us
+
+	// Inter-publish interval since the last reset_window() (us)
+	uint32_t interval_min;
+	uint32_t interval_max;
+	uint64_t interval_sum;
+	uint32_t interval_count;
+
+	// Samples that were overwritten before a subscriber read them
+	uint32_t missed;
+
+	void record_publish(void)
+	{
+		auto now = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+
+		if (publish_count > 0)
+		{
+			uint32_t interval = now - last_publish;
+
+			interval_min = interval_count == 0 || interval < interval_min ? interval : interval_min;
+			interval_max = interval > interval_max ? interval : interval_max;
+			interval_sum += interval;
+			interval_count++;
+		}
+
+		last_publish = now;
+		publish_count++;
+	}
+
+	void record_missed(uint32_t count)
+	{
+		__atomic_fetch_add(&missed, count, __ATOMIC_RELAXED);
+	}
+
+	void reset_window(void)
+	{
+		interval_min = 0;
+		interval_max = 0;
+		interval_sum = 0;
+		interval_count = 0;
+	}
 };
 
-struct __attribute__((__packed__)) setpoint_angle_s
+// Indexed by TopicId
+extern TopicStats TOPIC_STATS[TOPIC_COUNT];
+
+// Number of distinct tasks that can block on topics
+static constexpr size_t MAX_WAITING_TASKS = 8;
+
+// Static class! Maps waiting tasks to the topics they wait on. Tasks only register
+// during init, so a publish is just a read of the topic's waiter bitmask.
+class TopicRegistry
 {
-	abs_time_t timestamp;
-	float roll;
-	float pitch;
-	float yaw;
+public:
+	// Returns false if every task slot is taken
+	static bool add_waiter(TopicId topic, TaskHandle_t task);
+	static void remove_waiter(TopicId topic, TaskHandle_t task);
+
+	static void notify_waiters(TopicId topic)
+	{
+		uint32_t mask = _topic_waiters[topic];
+
+		while (mask)
+		{
+			unsigned slot = __builtin_ctz(mask);
+			mask &= mask - 1;
+
+			xTaskNotify(_tasks[slot], 1UL << topic, eSetBits);
+		}
+	}
+
+private:
+	static TaskHandle_t _tasks[MAX_WAITING_TASKS];
+	static uint8_t _refs[TOPIC_COUNT][MAX_WAITING_TASKS]; // subscribers per task per topic
+	static volatile uint32_t _topic_waiters[TOPIC_COUNT]; // bit n set == _tasks[n] waits on topic
 };
 
-// Multiple publisher multiple subscriber implementation
-// with a (SHARED!) data file.
-namespace messenger
+// Common part of every subscriber flavour -- lets the owning task block on a topic
+class TopicWaiter
 {
+public:
+	TopicWaiter(TopicId topic)
+		: _topic(topic)
+	{}
 
-template <typename T>
-class Subscriber;
+	~TopicWaiter()
+	{
+		if (_task != nullptr)
+		{
+			TopicRegistry::remove_waiter(_topic, _task);
+		}
+	}
+
+	// Ask for the given task to be notified on every publish. Only one task per subscriber.
+	bool register_task(TaskHandle_t task = xTaskGetCurrentTaskHandle())
+	{
+		if (_task != nullptr)
+		{
+			return _task == task;
+		}
+
+		if (TopicRegistry::add_waiter(_topic, task))
+		{
+			_task = task;
+			return true;
+		}
+
+		return false;
+	}
+
+protected:
+	// Blocks the calling task until updated() is true or the timeout (in ticks) expires.
+	// Registers the calling task on first use. NOTE: this uses the task notification
+	// value as a topic bitmask, so do not mix it with other notification users in the same task.
+	template <typename Updated>
+	bool wait(Updated updated, TickType_t timeout)
+	{
+		if (!register_task())
+		{
+			// No waiter slot left -- degrade to polling
+			while (!updated() && timeout-- > 0)
+			{
+				vTaskDelay(1);
+			}
+
+			return updated();
+		}
+
+		TimeOut_t time_out;
+		vTaskSetTimeOutState(&time_out);
+
+		// Notifications from other topics this task listens on can wake us early
+		while (!updated())
+		{
+			if (xTaskCheckForTimeOut(&time_out, &timeout) != pdFALSE)
+			{
+				return updated();
+			}
+
+			xTaskNotifyWait(0, 1UL << _topic, nullptr, timeout);
+		}
+
+		return true;
+	}
+
+	TopicId _topic;
+	TaskHandle_t _task = nullptr; // task woken on publish, if registered
+};
 
 // Static class!
-template <typename T>
+template <typename T, size_t N = topic_traits<T>::depth>
 class DataFile
 {
+	static_assert(N > 0 && (N & (N - 1)) == 0, "topic queue depth must be a power of 2");
+
 public:
-	static T& get_data(void)
-	{
-		return _data;
-	};
+	static constexpr size_t depth = N;
 
-	static void set_data(T data) { _data = data; };
-	static void add_subscriber(Subscriber<T>* sub)
+	// Sequence value of the newest completely written sample
+	static uint32_t newest_sequence(void)
 	{
-		_subscribers.push_back(sub);
+		return _sequence.load(std::memory_order_acquire) & ~1U;
 	}
 
-	static void notify_subscribers(void)
+	// Copies out the newest sample and returns its sequence value
+	static uint32_t get_data(T& data)
 	{
-		for (auto& s : _subscribers)
+		uint32_t sequence;
+
+		do
 		{
-			s->notify();
-		}
-	}
+			sequence = newest_sequence();
+
+		} while (!get_sample(sequence, data));
+
+		return sequence;
+	};
+
+	static T get_data(void)
+	{
+		T data;
+		get_data(data);
+		return data;
+	};
+
+	// Copies out the sample that completed at the given sequence value. Returns
+	// false if it has been (or is being) overwritten by a newer sample.
+	static bool get_sample(uint32_t sequence, T& data)
+	{
+		data = _data[slot(sequence)];
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// The slot is reused by the write that completes at sequence + 2N
+		uint32_t distance = _sequence.load(std::memory_order_relaxed) - sequence;
+
+		return distance <= 2 * (N - 1);
+	};
+
+	// Caller must hold off other writers -- see Publisher::publish()
+	static void set_data(const T& data)
+	{
+		auto sequence = _sequence.load(std::memory_order_relaxed);
+
+		_sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		_data[slot(sequence + 2)] = data;
+
+		_sequence.store(sequence + 2, std::memory_order_release);
+
+		stats().record_publish();
+	};
+
+	static TopicStats& stats(void) { return TOPIC_STATS[topic_traits<T>::id]; };
 
 protected:
-	static T _data; // static container for the data
-	static std::vector<Subscriber<T>*> _subscribers;
+	static size_t slot(uint32_t sequence) { return ((sequence >> 1) - 1) & (N - 1); };
+
+	static T _data[N]; // static container for the data
+	static std::atomic<uint32_t> _sequence; // odd while a write is in progress
 };
-template<class T>
-T DataFile<T>::_data {};
-template<class T>
-std::vector<Subscriber<T>*> DataFile<T>::_subscribers;
+template<class T, size_t N>
+T DataFile<T, N>::_data[N] {};
+template<class T, size_t N>
+std::atomic<uint32_t> DataFile<T, N>::_sequence {0};
 
 template <typename T>
-class Subscriber
+class Subscriber : public TopicWaiter
 {
+	static_assert(topic_traits<T>::kind == TopicKind::COPY, "loaned topic -- use LoanedSubscriber");
+
 public:
 	Subscriber()
-	{
-		taskENTER_CRITICAL();
+		: TopicWaiter(topic_traits<T>::id)
+		, _last_sequence(_file->newest_sequence())
+	{}
 
-		_file->add_subscriber(this);
-
-		taskEXIT_CRITICAL();
-	}
-
-	void notify(void)
+	bool updated(void)
 	{
-		_updated = true;
+		return _file->newest_sequence() != _last_sequence;
 	}
 
-	// Dumb impl -- subscribers must poll
-	bool updated(void)
+	bool wait_for_update(TickType_t timeout)
 	{
-		return _updated;
+		return wait([this] { return updated(); }, timeout);
 	}
 
 	T get(void)
 	{
-		taskENTER_CRITICAL();
+		T data;
 
-		auto data = _file->get_data();
-		_updated = false;
+		auto sequence = _file->get_data(data);
 
-		taskEXIT_CRITICAL();
+		// Everything between our last read and the newest sample was skipped
+		uint32_t unread = (sequence - _last_sequence) / 2;
+
+		if (unread > 1)
+		{
+			record_missed(unread - 1);
+		}
+
+		_last_sequence = sequence;
 
 		return data;
 	};
 
+	// Copies every sample published since the last read (oldest first) into buffer.
+	// Samples that were overwritten before we got to them are skipped.
+	size_t get_batch(T* buffer, size_t max)
+	{
+		auto newest = _file->newest_sequence();
+		size_t count = 0;
+
+		while (_last_sequence != newest && count < max)
+		{
+			// Jump ahead if the ring has lapped us
+			uint32_t unread = (newest - _last_sequence) / 2;
+
+			if (unread > _file->depth)
+			{
+				record_missed(unread - _file->depth);
+				_last_sequence = newest - 2 * _file->depth;
+			}
+
+			_last_sequence += 2;
+
+			if (_file->get_sample(_last_sequence, buffer[count]))
+			{
+				count++;
+			}
+			else
+			{
+				record_missed(1);
+			}
+		}
+
+		return count;
+	};
+
+	// Samples this subscriber never saw
+	uint32_t missed(void) { return _missed; };
+
 private:
-	bool _updated = false; // TODO: std::atomic
+	void record_missed(uint32_t count)
+	{
+		_missed += count;
+		_file->stats().record_missed(count);
+	}
+
+	uint32_t _last_sequence;
+	uint32_t _missed = 0;
 	DataFile<T>* _file;
 };
 
 template <typename T>
 class Publisher
 {
+	static_assert(topic_traits<T>::kind == TopicKind::COPY, "loaned topic -- use LoanedPublisher");
+
 public:
 	void publish(T& data)
 	{
-		taskENTER_CRITICAL();
+		// Serialize writers without masking interrupts
+		vTaskSuspendAll();
 
 		_file->set_data(data);
-		_file->notify_subscribers();
 
-		taskEXIT_CRITICAL();
+		xTaskResumeAll();
 
-		// TODO: notification / scheduling for dependent work.
+		TopicRegistry::notify_waiters(topic_traits<T>::id);
 	}
 private:
 	DataFile<T>* _file;
 };
 
+//-------------------- Loaned messages --------------------//
+
+// Read-only view of a loaned slot. Releases the slot when it goes out of scope.
+template <typename T>
+class Loan
+{
+public:
+	Loan() = default;
+
+	Loan(const T* data, std::atomic<uint8_t>* refs)
+		: _data(data)
+		, _refs(refs)
+	{}
+
+	Loan(Loan&& other)
+		: _data(other._data)
+		, _refs(other._refs)
+	{
+		other._data = nullptr;
+		other._refs = nullptr;
+	}
+
+	Loan& operator=(Loan&& other)
+	{
+		if (this != &other)
+		{
+			release();
+			_data = other._data;
+			_refs = other._refs;
+			other._data = nullptr;
+			other._refs = nullptr;
+		}
+
+		return *this;
+	}
+
+	Loan(const Loan&) = delete;
+	Loan& operator=(const Loan&) = delete;
+
+	~Loan() { release(); }
+
+	void release(void)
+	{
+		if (_refs != nullptr)
+		{
+			_refs->fetch_sub(1, std::memory_order_release);
+		}
+
+		_data = nullptr;
+		_refs = nullptr;
+	}
+
+	explicit operator bool() const { return _data != nullptr; };
+	const T& operator*() const { return *_data; };
+	const T* operator->() const { return _data; };
+
+private:
+	const T* _data = nullptr;
+	std::atomic<uint8_t>* _refs = nullptr;
+};
+
+// Static class! Fixed pool of slots for a loaned topic. Every slot carries a reference
+// count: the publisher holds one while filling it, the file holds one on the newest
+// slot and each outstanding Loan holds one. SLOTS must cover every Loan that can be
+// held at once plus the newest slot plus the one being filled.
+template <typename T, size_t SLOTS = topic_traits<T>::depth>
+class LoanFile
+{
+	static_assert(SLOTS >= 2 && SLOTS < 128, "loan pool needs room for the newest slot and the one being filled");
+
+public:
+	static uint32_t sequence(void) { return _sequence.load(std::memory_order_acquire); };
+
+	// Returns a free slot to fill in place, or nullptr if every slot is still on loan
+	static T* loan(void)
+	{
+		for (size_t i = 0; i < SLOTS; i++)
+		{
+			uint8_t expected = 0;
+
+			if (_refs[i].compare_exchange_strong(expected, 1, std::memory_order_acquire))
+			{
+				return &_slots[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Makes the slot the newest sample -- the publisher's reference passes to the file
+	static void commit(T* data)
+	{
+		int8_t slot = data - _slots;
+
+		vTaskSuspendAll();
+
+		int8_t previous = _newest;
+		_newest = slot;
+		_sequence.fetch_add(1, std::memory_order_release);
+
+		TOPIC_STATS[topic_traits<T>::id].record_publish();
+
+		xTaskResumeAll();
+
+		if (previous >= 0)
+		{
+			_refs[previous].fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	// Gives back a loaned slot without publishing it
+	static void cancel(T* data)
+	{
+		_refs[data - _slots].fetch_sub(1, std::memory_order_release);
+	}
+
+	static Loan<T> acquire(uint32_t& sequence)
+	{
+		Loan<T> loan;
+
+		// Taking the reference must not race with commit() dropping the file's one
+		vTaskSuspendAll();
+
+		int8_t slot = _newest;
+
+		if (slot >= 0)
+		{
+			_refs[slot].fetch_add(1, std::memory_order_acquire);
+			loan = Loan<T>(&_slots[slot], &_refs[slot]);
+		}
+
+		sequence = _sequence.load(std::memory_order_relaxed);
+
+		xTaskResumeAll();
+
+		return loan;
+	}
+
+private:
+	static T _slots[SLOTS];
+	static std::atomic<uint8_t> _refs[SLOTS];
+	static volatile int8_t _newest; // -1 until the first commit
+	static std::atomic<uint32_t> _sequence;
+};
+template<class T, size_t SLOTS>
+T LoanFile<T, SLOTS>::_slots[SLOTS];
+template<class T, size_t SLOTS>
+std::atomic<uint8_t> LoanFile<T, SLOTS>::_refs[SLOTS] {};
+template<class T, size_t SLOTS>
+volatile int8_t LoanFile<T, SLOTS>::_newest = -1;
+template<class T, size_t SLOTS>
+std::atomic<uint32_t> LoanFile<T, SLOTS>::_sequence {0};
+
+template <typename T>
+class LoanedPublisher
+{
+	static_assert(topic_traits<T>::kind == TopicKind::LOAN, "copied topic -- use Publisher");
+
+public:
+	// Fill the returned slot and hand it to publish() -- or cancel() it
+	T* loan(void) { return _file->loan(); };
+
+	void publish(T* data)
+	{
+		_file->commit(data);
+
+		TopicRegistry::notify_waiters(topic_traits<T>::id);
+	}
+
+	void cancel(T* data) { _file->cancel(data); };
+
+private:
+	LoanFile<T>* _file;
+};
+
+template <typename T>
+class LoanedSubscriber : public TopicWaiter
+{
+	static_assert(topic_traits<T>::kind == TopicKind::LOAN, "copied topic -- use Subscriber");
+
+public:
+	LoanedSubscriber()
+		: TopicWaiter(topic_traits<T>::id)
+		, _last_sequence(_file->sequence())
+	{}
+
+	bool updated(void)
+	{
+		return _file->sequence() != _last_sequence;
+	}
+
+	bool wait_for_update(TickType_t timeout)
+	{
+		return wait([this] { return updated(); }, timeout);
+	}
+
+	// Empty until the first publish. Hold the loan only as long as needed.
+	Loan<T> get(void)
+	{
+		uint32_t previous = _last_sequence;
+		Loan<T> loan = _file->acquire(_last_sequence);
+
+		// Only the newest slot is handed out, anything committed in between was skipped
+		uint32_t unread = _last_sequence - previous;
+
+		if (unread > 1)
+		{
+			record_missed(unread - 1);
+		}
+
+		return loan;
+	}
+
+	uint32_t missed(void) { return _missed; };
+
+private:
+	void record_missed(uint32_t count)
+	{
+		_missed += count;
+		TOPIC_STATS[topic_traits<T>::id].record_missed(count);
+	}
+
+	uint32_t _last_sequence;
+	uint32_t _missed = 0;
+	LoanFile<T>* _file;
+};
+
 } // end namespace messenger
@@ -22,15 +22,18 @@
 
 #include <board_config.hpp>
 #include <timers/Time.hpp>
+#include <interrupt_lock.hpp>
 
 static void init_FTM0(void);
 static void init_serial(void);
+static void load_crash_record(void);
 
 // CMSIS compliance or something...
 extern "C" void SystemInit(void)
 {
 	init_FTM0();
 	init_serial();
+	load_crash_record();
 }
 
 #define PS_DIV_1 0b000
@@ -48,9 +51,10 @@ extern "C" void SystemInit(void)
 // Frequency: 60MHz (F_BUS)
 // counter: 16bit
 // prescaler: 1
-// modulo: 6,000 == FTM1_MAX_TICKS
+// modulo: 59,999 == FTM0_MAX_TICKS - 1
 // resolution: 16.6666ns
-// overflow rate: 0.1ms --> 10kHz
+// overflow rate: 1ms --> 1kHz
+// channel 0: software output compare for the dispatch deadline
 static void init_FTM0(void)
 {
 	// Disable write protection to change the settings -- TODO reenable write protection?
@@ -61,13 +65,15 @@ static void init_FTM0(void)
 	}
 
 	FTM0_CNT = 0x0000; //reset count to zero
-	FTM0_MOD = FTM0_MAX_TICKS; //max modulus = 6,000 (@60Mhz, 6,000 ticks == 0.1ms)
+	FTM0_MOD = FTM0_MAX_TICKS - 1; // counts 0 - 59,999 (@60Mhz, 60,000 ticks == 1ms)
+	FTM0_C0SC = FTM_CSC_MSA; // output compare, no pin, interrupt enabled once a deadline is set
 	// Turn the timer on and configure with our settings
 	FTM0_SC = FTM_SC_CLKS(FTM_SYS_CLK) // Set to system clock
 			| FTM_SC_PS(PS_DIV_1) // set prescaler for desired resolution / overflow rate
 			| FTM_SC_TOIE; // enable overflow interrupt
 
-	FTM0_MODE |= FTM_MODE_FTMEN;
+	// FTMEN stays clear so that C0V writes take effect on the next tick rather than
+	// waiting for a synchronization event
 
 	NVIC_ENABLE_IRQ(IRQ_FTM0);
 }
@@ -79,15 +85,96 @@ static void init_serial(void)
 	SYS_INFO("\n---------- App ----------\n");
 }
 
-// So that we know if we've blown a stack
-extern "C" void vApplicationStackOverflowHook( TaskHandle_t xTask, signed char *pcTaskName )
+//---- CRASH RECORD ----//
+static constexpr uint32_t CRASH_RECORD_MAGIC = 0xDEADC0DE;
+
+// .noinit is neither loaded nor zeroed by the startup code
+__attribute__((section(".noinit"))) static CrashRecord _crash_record;
+static CrashRecord _last_crash = {};
+static volatile uint32_t _malloc_failures = 0;
+
+const CrashRecord& last_crash(void)
 {
-	// This must be the LED
-	pinMode(13, OUTPUT);
+	return _last_crash;
+}
 
-	while (1)
+uint32_t malloc_failures(void)
+{
+	return _malloc_failures;
+}
+
+const char* crash_reason_name(CrashReason reason)
+{
+	switch (reason)
 	{
-		// TODO: This has literally never worked
-		digitalWrite(13, HIGH);
+	case CrashReason::STACK_OVERFLOW:
+		return "stack overflow";
+	case CrashReason::MALLOC_FAILED:
+		return "out of heap";
+	default:
+		return "unknown";
 	}
 }
+
+static void load_crash_record(void)
+{
+	if (_crash_record.magic != CRASH_RECORD_MAGIC)
+	{
+		return;
+	}
+
+	_last_crash = _crash_record;
+	_last_crash.task_name[configMAX_TASK_NAME_LEN - 1] = '\0';
+	_crash_record.magic = 0;
+
+	SYS_INFO("Last run crashed: %s in %s", crash_reason_name(_last_crash.reason), _last_crash.task_name);
+	SYS_INFO("  after %lu ms, %lu bytes heap free", _last_crash.uptime_ms, _last_crash.free_heap);
+}
+
+static void write_crash_record(CrashReason reason, const char* task_name)
+{
+	_crash_record.magic = 0;
+	_crash_record.reason = reason;
+	_crash_record.uptime_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	_crash_record.free_heap = xPortGetFreeHeapSize();
+	strncpy(_crash_record.task_name, task_name, configMAX_TASK_NAME_LEN - 1);
+	_crash_record.task_name[configMAX_TASK_NAME_LEN - 1] = '\0';
+
+	// Last, so that a half written record is never reported
+	_crash_record.magic = CRASH_RECORD_MAGIC;
+}
+
+static void record_crash(CrashReason reason, const char* task_name)
+{
+	taskDISABLE_INTERRUPTS();
+
+	write_crash_record(reason, task_name);
+
+	// Reset -- the record is reported on the next boot
+	SCB_AIRCR = 0x05FA0004;
+
+	for (;;);
+}
+
+// So that we know if we've blown a stack
+extern "C" void vApplicationStackOverflowHook( TaskHandle_t xTask, signed char *pcTaskName )
+{
+	record_crash(CrashReason::STACK_OVERFLOW, reinterpret_cast<const char*>(pcTaskName));
+}
+
+extern "C" void vApplicationMallocFailedHook(void)
+{
+	bool started = xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+	const char* task_name = started ? pcTaskGetName(NULL) : "startup";
+
+#if RESET_ON_MALLOC_FAILED
+	record_crash(CrashReason::MALLOC_FAILED, task_name);
+#else
+	// The caller gets a nullptr and deals with it (the pool allocator counts its own),
+	// the record is only reported if something else resets the board later
+	InterruptLock lock;
+
+	_malloc_failures++;
+	write_crash_record(CrashReason::MALLOC_FAILED, task_name);
+#endif
+}
@@ -22,8 +22,6 @@
 
 #pragma once
 
-#include <functional>
-
 #include <Arduino.h>
 #include "core_pins.h"
 #include <kinetis.h>
@@ -33,6 +31,9 @@
 
 #include <spi4teensy3.hpp>
 
+#include <InplaceFunction.hpp>
+#include <static_allocation.hpp>
+
 #define BOUNCE(c,m) bounce<c, decltype(&c::m), &c::m>
 
 // Bounce for C++ --> C function callbacks
@@ -43,7 +44,8 @@ static auto bounce(void *priv, Params... params) ->
 	return ((*reinterpret_cast<T *>(priv)).*m)(params...);
 }
 
-typedef std::function<void(void)> fp_t;
+// Never allocates -- a lambda capturing more than 16 bytes will not compile
+typedef InplaceFunction<void(void), 16> fp_t;
 
 // Helpers for understanding my config
 #define STR_HELPER(x) #x
@@ -72,4 +74,30 @@ enum PriorityLevel : uint8_t
 {
 	LOWEST = 0,
 	HIGHEST = configMAX_PRIORITIES,
-};
\ No newline at end of file
+};
+
+enum class CrashReason : uint32_t
+{
+	NONE,
+	STACK_OVERFLOW,
+	MALLOC_FAILED,
+};
+
+// Written by the fault hooks into RAM that survives the reset that follows, and
+// reported at the next boot. A failed heap allocation only resets with
+// RESET_ON_MALLOC_FAILED, otherwise its record waits for whatever reset comes next.
+struct CrashRecord
+{
+	uint32_t magic;
+	CrashReason reason;
+	uint32_t uptime_ms;
+	uint32_t free_heap;
+	char task_name[configMAX_TASK_NAME_LEN];
+};
+
+// The record left by the previous run, reason is NONE after a clean boot
+const CrashRecord& last_crash(void);
+const char* crash_reason_name(CrashReason reason);
+
+// heap_4 allocations that returned nullptr since boot
+uint32_t malloc_failures(void);
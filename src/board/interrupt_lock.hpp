@@ -0,0 +1,53 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <kinetis.h>
+
+// Masks every interrupt for as long as it is in scope and then puts PRIMASK back the way
+// it found it, so it nests and works from an ISR. Unlike taskENTER_CRITICAL() it does
+// not depend on the scheduler: until vTaskStartScheduler() uxCriticalNesting is still
+// 0xaaaaaaaa and taskEXIT_CRITICAL() would leave interrupts masked. Keep it short.
+class InterruptLock
+{
+public:
+	InterruptLock(void)
+	{
+		__asm__ volatile("mrs %0, primask\n" : "=r" (_primask)::);
+		__disable_irq();
+	}
+
+	~InterruptLock(void)
+	{
+		if (_primask == 0)
+		{
+			__enable_irq();
+		}
+	}
+
+	InterruptLock(const InterruptLock&) = delete;
+	InterruptLock& operator=(const InterruptLock&) = delete;
+
+private:
+	uint32_t _primask;
+};
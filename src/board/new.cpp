@@ -22,33 +22,64 @@
 
 #include "new.hpp"
 
+#include <task.h>
+#include <PoolAllocator.hpp>
+
+#if STATIC_ALLOCATION
+static void check_allocation_policy(void)
+{
+	// Everything that exists before the scheduler starts must come from static storage
+	configASSERT(xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED);
+
+	// Refuse the heap altogether
+	configASSERT(HEAP_AFTER_STARTUP);
+}
+#endif
+
+// Small blocks come from the fixed size pools, only large ones reach heap_4
+static void* allocate(size_t size)
+{
+#if STATIC_ALLOCATION
+	check_allocation_policy();
+#endif
+
+	return memory::allocate(size);
+}
+
 void* operator new(size_t size)
 {
-  return pvPortMalloc(size);
+  return allocate(size);
 }
 
 void* operator new[](size_t size)
 {
-  return pvPortMalloc(size);
+  return allocate(size);
 }
 
 void operator delete(void* ptr)
 {
-  vPortFree(ptr);
+  memory::deallocate(ptr);
 }
 
 void operator delete[](void* ptr)
 {
-  vPortFree(ptr);
+  memory::deallocate(ptr);
 }
 
 void operator delete(void* ptr, size_t size)
 {
-  vPortFree(ptr);
+  memory::deallocate(ptr);
 }
 
 void operator delete[](void* ptr, size_t size)
 {
-  vPortFree(ptr);
+  memory::deallocate(ptr);
 }
 
+#if STATIC_ALLOCATION
+// Called by heap_4 for every allocation -- including the kernel's own
+extern "C" void vApplicationHeapAllocationHook(void* address, size_t size)
+{
+	check_allocation_policy();
+}
+#endif
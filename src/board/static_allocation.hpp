@@ -0,0 +1,62 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <FreeRTOS.h>
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Build with STATIC_ALLOCATION=1 to give every task, DispatchQueue and driver object its
+// own statically sized storage (see task_table.hpp). HEAP_AFTER_STARTUP then chooses
+// whether heap_4 may be used at all once the scheduler is running.
+
+// Uninitialized storage for one T, constructed in place at most once. Trivial so that a
+// function local static is zero initialized without a guard variable.
+template <typename T>
+class StaticObject
+{
+public:
+	template <typename... Args>
+	T* construct(Args&&... args)
+	{
+		configASSERT(!_constructed);
+		_constructed = true;
+
+		return new (&_storage) T(std::forward<Args>(args)...);
+	}
+
+	T* get(void) { return _constructed ? reinterpret_cast<T*>(&_storage) : nullptr; };
+
+private:
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+	bool _constructed;
+};
+
+#if STATIC_ALLOCATION
+// Every expansion gets its own storage, so it must only ever run once
+#define STATIC_NEW(T, ...) ([&]() { static StaticObject<T> _static_object_; return _static_object_.construct(__VA_ARGS__); }())
+#else
+#define STATIC_NEW(T, ...) (new T(__VA_ARGS__))
+#endif
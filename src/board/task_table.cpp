@@ -0,0 +1,116 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <task_table.hpp>
+#include <DispatchQueue.hpp>
+
+#define BOARD_TASK_ENTRY(entry, name, depth, priority) extern void entry(void* args);
+BOARD_TASKS(BOARD_TASK_ENTRY)
+#undef BOARD_TASK_ENTRY
+
+#if STATIC_ALLOCATION
+
+template <size_t StackDepth>
+struct TaskStorage
+{
+	StackType_t stack[StackDepth];
+	StaticTask_t tcb;
+};
+
+template <size_t StackDepth>
+struct DispatchQueueStorage
+{
+	StackType_t stack[StackDepth];
+	StaticObject<DispatchQueue> queue;
+};
+
+// One symbol per task and queue so that nm can report the RAM each one uses
+#define BOARD_TASK_STORAGE(entry, name, depth, priority) static TaskStorage<depth> task_ram_##entry;
+BOARD_TASKS(BOARD_TASK_STORAGE)
+#undef BOARD_TASK_STORAGE
+
+#define BOARD_QUEUE_STORAGE(id, depth, priority) static DispatchQueueStorage<depth> queue_ram_##id;
+BOARD_DISPATCH_QUEUES(BOARD_QUEUE_STORAGE)
+#undef BOARD_QUEUE_STORAGE
+
+static TaskStorage<configMINIMAL_STACK_SIZE> task_ram_idle;
+static TaskStorage<configTIMER_TASK_STACK_DEPTH> task_ram_timer;
+
+// The kernel's own tasks, required by configSUPPORT_STATIC_ALLOCATION
+extern "C" void vApplicationGetIdleTaskMemory(StaticTask_t** tcb, StackType_t** stack, uint32_t* depth)
+{
+	*tcb = &task_ram_idle.tcb;
+	*stack = task_ram_idle.stack;
+	*depth = configMINIMAL_STACK_SIZE;
+}
+
+extern "C" void vApplicationGetTimerTaskMemory(StaticTask_t** tcb, StackType_t** stack, uint32_t* depth)
+{
+	*tcb = &task_ram_timer.tcb;
+	*stack = task_ram_timer.stack;
+	*depth = configTIMER_TASK_STACK_DEPTH;
+}
+
+#endif
+
+namespace board
+{
+
+void create_tasks(void)
+{
+#if STATIC_ALLOCATION
+#define BOARD_CREATE_TASK(entry, name, depth, priority) \
+	xTaskCreateStatic(entry, name, depth, NULL, priority, task_ram_##entry.stack, &task_ram_##entry.tcb);
+#else
+#define BOARD_CREATE_TASK(entry, name, depth, priority) \
+	xTaskCreate(entry, name, depth, NULL, priority, NULL);
+#endif
+
+	BOARD_TASKS(BOARD_CREATE_TASK)
+
+#undef BOARD_CREATE_TASK
+}
+
+DispatchQueue* create_dispatch_queue(QueueId id)
+{
+	switch (id)
+	{
+#if STATIC_ALLOCATION
+#define BOARD_CREATE_QUEUE(id, depth, priority) \
+	case QueueId::id: \
+		return queue_ram_##id.queue.construct(#id, priority, queue_ram_##id.stack, depth);
+#else
+#define BOARD_CREATE_QUEUE(id, depth, priority) \
+	case QueueId::id: \
+		return new DispatchQueue(#id, priority, depth);
+#endif
+
+	BOARD_DISPATCH_QUEUES(BOARD_CREATE_QUEUE)
+
+#undef BOARD_CREATE_QUEUE
+
+	default:
+		return nullptr;
+	}
+}
+
+} // end namespace board
@@ -0,0 +1,65 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <board_config.hpp>
+
+class DispatchQueue;
+
+// Every task in the system: X(entry, name, stack depth in words, priority)
+//
+// With STATIC_ALLOCATION each one gets a task_ram_<entry> symbol holding its stack and
+// TCB, the build prints their sizes after linking.
+#define BOARD_TASKS(X) \
+	X(sanity_idle_task,		"sanity_idle_task",		configMINIMAL_STACK_SIZE,		PriorityLevel::LOWEST) \
+	X(shell_task,			"shell_task",			configMINIMAL_STACK_SIZE * 4,	PriorityLevel::LOWEST+1) \
+	X(led_task,				"led_task",				configMINIMAL_STACK_SIZE * 3,	PriorityLevel::LOWEST+1) \
+	X(estimator_task,		"estimator",			configMINIMAL_STACK_SIZE * 3,	PriorityLevel::LOWEST+1) \
+	X(frsky_task,			"frsky",				configMINIMAL_STACK_SIZE * 4,	PriorityLevel::LOWEST+2) \
+	X(dispatch_test_task,	"dispatch_test_task",	configMINIMAL_STACK_SIZE * 5,	PriorityLevel::HIGHEST) \
+	X(imu_task,				"imu_task",				configMINIMAL_STACK_SIZE * 5,	PriorityLevel::HIGHEST-1) \
+	X(controller_task,		"controller_task",		configMINIMAL_STACK_SIZE * 5,	PriorityLevel::HIGHEST-1) \
+	X(memory_monitor_task,	"memory_monitor",		configMINIMAL_STACK_SIZE * 2,	PriorityLevel::LOWEST+1)
+
+// Every DispatchQueue: X(id, stack depth in words, priority) -- queue_ram_<id> with STATIC_ALLOCATION
+#define BOARD_DISPATCH_QUEUES(X) \
+	X(dummy_q,				1024,							PriorityLevel::HIGHEST)
+
+#define BOARD_QUEUE_ID(id, depth, priority) id,
+enum class QueueId : uint8_t
+{
+	BOARD_DISPATCH_QUEUES(BOARD_QUEUE_ID)
+	COUNT
+};
+#undef BOARD_QUEUE_ID
+
+namespace board
+{
+
+// Creates every task in BOARD_TASKS, call once before vTaskStartScheduler()
+void create_tasks(void);
+
+// Creates the queue from its BOARD_DISPATCH_QUEUES entry, once per id
+DispatchQueue* create_dispatch_queue(QueueId id);
+
+} // end namespace board
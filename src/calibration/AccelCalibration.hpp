@@ -28,6 +28,7 @@
 #include <Messenger.hpp>
 #include <Time.hpp>
 #include <LowPassFilter.hpp>
+#include <SensorCalibration.hpp>
 
 static constexpr float BIG_ENOUGH = 9.0f;
 static constexpr float GRAVITY_ACCEL = 9.80665f;
@@ -57,6 +58,13 @@ public:
 
 	void calculate_offsets_and_scales(void);
 
+	// Valid after calculate_offsets_and_scales(), measured with the accel uncalibrated
+	calibration::SensorCalibration result(void) const
+	{
+		return calibration::SensorCalibration::diagonal(_x_offset, _y_offset, _z_offset,
+			_x_scale, _y_scale, _z_scale);
+	}
+
 	bool all_sides_complete(void)
 	{
 		return 	_upside_up_calibrated && _upside_down_calibrated &&
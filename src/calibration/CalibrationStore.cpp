@@ -0,0 +1,207 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <CalibrationStore.hpp>
+#include <Time.hpp>
+
+#include <avr/eeprom.h>
+
+namespace calibration
+{
+
+// Gyro -- offsets only
+static constexpr SensorCalibration DEFAULT_GYRO = SensorCalibration::diagonal(
+	-0.011789f, 0.032313f, 0.027732f,
+	1.0f, 1.0f, 1.0f);
+
+// Accel -- six side offsets and scales
+static constexpr SensorCalibration DEFAULT_ACCEL = SensorCalibration::diagonal(
+	0.291080f, 0.200403f, -0.378607f,
+	1.001776f, 1.001551f, 0.985408f);
+
+// Mag -- TODO: investigate why a single outlier fucks up the ellipsoid fit algorithm
+static constexpr SensorCalibration DEFAULT_MAG = SensorCalibration::diagonal(
+	10.0653f, 34.8082f, -159.862f,
+	1 / 289.209f, 1 / 282.384f, 1 / 262.062f);
+
+static constexpr uint32_t RECORD_MAGIC = 0x314C4143; // "CAL1"
+static constexpr uint16_t RECORD_VERSION = 1;
+static constexpr uintptr_t RECORD_ADDRESS = 0; // the start of the EEPROM
+
+struct CalibrationRecord
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t size;
+	SensorCalibration sensors[SENSOR_COUNT];
+	uint32_t checksum; // over everything before it
+};
+
+static_assert(sizeof(CalibrationRecord) <= E2END + 1, "calibration record does not fit the EEPROM");
+
+static SensorCalibration _current[SENSOR_COUNT] = { DEFAULT_GYRO, DEFAULT_ACCEL, DEFAULT_MAG };
+
+static const char* SENSOR_NAMES[SENSOR_COUNT] = { "gyro", "accel", "mag" };
+
+// FNV-1a
+static uint32_t checksum(const CalibrationRecord& record)
+{
+	auto bytes = reinterpret_cast<const uint8_t*>(&record);
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < offsetof(CalibrationRecord, checksum); i++)
+	{
+		hash = (hash ^ bytes[i]) * 16777619U;
+	}
+
+	return hash;
+}
+
+static void publish(void)
+{
+	sensor_calibration_s msg;
+	to_message(msg);
+
+	messenger::Publisher<sensor_calibration_s> publisher;
+	publisher.publish(msg);
+}
+
+bool load(void)
+{
+	CalibrationRecord record;
+	eeprom_read_block(&record, reinterpret_cast<const void*>(RECORD_ADDRESS), sizeof(record));
+
+	bool valid = record.magic == RECORD_MAGIC && record.version == RECORD_VERSION &&
+		record.size == sizeof(record) && record.checksum == checksum(record);
+
+	if (valid)
+	{
+		vTaskSuspendAll();
+		memcpy(_current, record.sensors, sizeof(_current));
+		xTaskResumeAll();
+	}
+	else
+	{
+		SYS_INFO("No stored calibration, using defaults");
+	}
+
+	publish();
+
+	return valid;
+}
+
+void save(void)
+{
+	CalibrationRecord record = {};
+
+	record.magic = RECORD_MAGIC;
+	record.version = RECORD_VERSION;
+	record.size = sizeof(record);
+
+	vTaskSuspendAll();
+	memcpy(record.sensors, _current, sizeof(record.sensors));
+	xTaskResumeAll();
+
+	record.checksum = checksum(record);
+
+	eeprom_write_block(&record, reinterpret_cast<void*>(RECORD_ADDRESS), sizeof(record));
+}
+
+void reset(void)
+{
+	vTaskSuspendAll();
+	_current[static_cast<size_t>(Sensor::GYRO)] = DEFAULT_GYRO;
+	_current[static_cast<size_t>(Sensor::ACCEL)] = DEFAULT_ACCEL;
+	_current[static_cast<size_t>(Sensor::MAG)] = DEFAULT_MAG;
+	xTaskResumeAll();
+
+	publish();
+}
+
+SensorCalibration get(Sensor sensor)
+{
+	vTaskSuspendAll();
+	SensorCalibration calibration = _current[static_cast<size_t>(sensor)];
+	xTaskResumeAll();
+
+	return calibration;
+}
+
+void set(Sensor sensor, const SensorCalibration& calibration)
+{
+	vTaskSuspendAll();
+	_current[static_cast<size_t>(sensor)] = calibration;
+	xTaskResumeAll();
+
+	publish();
+}
+
+const char* sensor_name(Sensor sensor)
+{
+	return SENSOR_NAMES[static_cast<size_t>(sensor)];
+}
+
+void to_message(sensor_calibration_s& msg)
+{
+	msg.timestamp = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+
+	vTaskSuspendAll();
+
+	const SensorCalibration& gyro = _current[static_cast<size_t>(Sensor::GYRO)];
+	const SensorCalibration& accel = _current[static_cast<size_t>(Sensor::ACCEL)];
+	const SensorCalibration& mag = _current[static_cast<size_t>(Sensor::MAG)];
+
+	memcpy(msg.gyro_bias, gyro.bias, sizeof(msg.gyro_bias));
+	memcpy(msg.gyro_matrix, gyro.matrix, sizeof(msg.gyro_matrix));
+	memcpy(msg.accel_bias, accel.bias, sizeof(msg.accel_bias));
+	memcpy(msg.accel_matrix, accel.matrix, sizeof(msg.accel_matrix));
+	memcpy(msg.mag_bias, mag.bias, sizeof(msg.mag_bias));
+	memcpy(msg.mag_matrix, mag.matrix, sizeof(msg.mag_matrix));
+
+	xTaskResumeAll();
+}
+
+SensorCalibration from_message(const sensor_calibration_s& msg, Sensor sensor)
+{
+	SensorCalibration calibration;
+
+	switch (sensor)
+	{
+	case Sensor::GYRO:
+		memcpy(calibration.bias, msg.gyro_bias, sizeof(calibration.bias));
+		memcpy(calibration.matrix, msg.gyro_matrix, sizeof(calibration.matrix));
+		break;
+
+	case Sensor::ACCEL:
+		memcpy(calibration.bias, msg.accel_bias, sizeof(calibration.bias));
+		memcpy(calibration.matrix, msg.accel_matrix, sizeof(calibration.matrix));
+		break;
+
+	default:
+		memcpy(calibration.bias, msg.mag_bias, sizeof(calibration.bias));
+		memcpy(calibration.matrix, msg.mag_matrix, sizeof(calibration.matrix));
+		break;
+	}
+
+	return calibration;
+}
+
+} // end namespace calibration
@@ -0,0 +1,53 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <board_config.hpp>
+#include <Messenger.hpp>
+#include <SensorCalibration.hpp>
+
+// The IMU calibration lives in EEPROM and is published on the sensor_calibration topic,
+// so new parameters take effect without a rebuild. Until something valid has been
+// saved the compiled in defaults are used.
+namespace calibration
+{
+
+// EEPROM -> current parameters, then publishes them. Returns false if the EEPROM
+// holds nothing valid and the defaults were kept.
+bool load(void);
+
+// Current parameters -> EEPROM. Slow, the flash emulation erases as it goes.
+void save(void);
+
+// Back to the compiled in defaults and publishes them, the EEPROM is left alone
+void reset(void);
+
+SensorCalibration get(Sensor sensor);
+void set(Sensor sensor, const SensorCalibration& calibration); // publishes
+
+const char* sensor_name(Sensor sensor);
+
+// Fills in a sensor_calibration message / reads one back
+void to_message(sensor_calibration_s& msg);
+SensorCalibration from_message(const sensor_calibration_s& msg, Sensor sensor);
+
+} // end namespace calibration
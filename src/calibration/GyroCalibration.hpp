@@ -25,6 +25,7 @@
 #include <board_config.hpp>
 #include <Messenger.hpp>
 #include <Time.hpp>
+#include <SensorCalibration.hpp>
 
 class GyroCalibration
 {
@@ -53,14 +54,27 @@ public:
 			now = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
 		}
 
-		auto x_offset = _accumulate_x / num_samples;
-		auto y_offset = _accumulate_y / num_samples;
-		auto z_offset = _accumulate_z / num_samples;
+		_x_offset = _accumulate_x / num_samples;
+		_y_offset = _accumulate_y / num_samples;
+		_z_offset = _accumulate_z / num_samples;
 
 		// Offset is the average value of the measurement
-		SYS_INFO("gyro_offset_x: %f", x_offset);
-		SYS_INFO("gyro_offset_y: %f", y_offset);
-		SYS_INFO("gyro_offset_z: %f", z_offset);
+		SYS_INFO("gyro_offset_x: %f", _x_offset);
+		SYS_INFO("gyro_offset_y: %f", _y_offset);
+		SYS_INFO("gyro_offset_z: %f", _z_offset);
+	}
+
+	// The measured offsets as the bias, the matrix is kept. Valid after calibrate(),
+	// which must have run with the gyro uncalibrated.
+	calibration::SensorCalibration result(const calibration::SensorCalibration& current) const
+	{
+		calibration::SensorCalibration calibration = current;
+
+		calibration.bias[0] = _x_offset;
+		calibration.bias[1] = _y_offset;
+		calibration.bias[2] = _z_offset;
+
+		return calibration;
 	}
 
 private:
@@ -69,4 +83,8 @@ private:
 	double _accumulate_y = 0;
 	double _accumulate_z = 0;
 
+	float _x_offset = 0;
+	float _y_offset = 0;
+	float _z_offset = 0;
+
 };
\ No newline at end of file
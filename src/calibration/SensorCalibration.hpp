@@ -0,0 +1,70 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace calibration
+{
+
+enum class Sensor : uint8_t
+{
+	GYRO = 0,
+	ACCEL,
+	MAG,
+	COUNT
+};
+
+static constexpr size_t SENSOR_COUNT = static_cast<size_t>(Sensor::COUNT);
+
+// A bias vector plus a full 3x3 matrix that covers scale, axis misalignment and
+// mounting rotation in one go
+struct SensorCalibration
+{
+	float bias[3];
+	float matrix[3][3];
+
+	// corrected = matrix * (raw - bias), in place -- 3 subtractions and 9 multiply-adds
+	void apply(float& x, float& y, float& z) const
+	{
+		float dx = x - bias[0];
+		float dy = y - bias[1];
+		float dz = z - bias[2];
+
+		x = matrix[0][0] * dx + matrix[0][1] * dy + matrix[0][2] * dz;
+		y = matrix[1][0] * dx + matrix[1][1] * dy + matrix[1][2] * dz;
+		z = matrix[2][0] * dx + matrix[2][1] * dy + matrix[2][2] * dz;
+	}
+
+	static constexpr SensorCalibration identity(void)
+	{
+		return { { 0, 0, 0 }, { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } } };
+	}
+
+	static constexpr SensorCalibration diagonal(float bx, float by, float bz, float sx, float sy, float sz)
+	{
+		return { { bx, by, bz }, { { sx, 0, 0 }, { 0, sy, 0 }, { 0, 0, sz } } };
+	}
+};
+
+} // end namespace calibration
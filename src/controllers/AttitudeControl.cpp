@@ -24,7 +24,7 @@
 
 AttitudeControl::AttitudeControl()
 {
-	_pwm = new Pwm(400);
+	_pwm = STATIC_NEW(Pwm, 400);
 
 	//----- Rate controller settings -----//
 	float p = 0.08; // turn up P until we overshoot 1/2 our overshoot spec
@@ -32,22 +32,22 @@ AttitudeControl::AttitudeControl()
 	float d = 3.2; // 6 causes oscillations, so we turn down by 2/3
 	float max_effort = 1; // torque is just scaled between -1 and 1
 	float max_integrator = 0.3; // 30% of output
-	_pitch_rate_controller = new controllers::PIDController(p, i, d, max_effort, max_integrator);
-	_roll_rate_controller = new controllers::PIDController(p, i, d, max_effort, max_integrator);
+	_pitch_rate_controller = STATIC_NEW(controllers::PIDController, p, i, d, max_effort, max_integrator);
+	_roll_rate_controller = STATIC_NEW(controllers::PIDController, p, i, d, max_effort, max_integrator);
 
 	// Yaw rate controller is special
 	p = 0.08;
 	i = 0.0;
 	d = 0.0;
-	_yaw_rate_controller = new controllers::PIDController(p, i, d, max_effort, 0);
+	_yaw_rate_controller = STATIC_NEW(controllers::PIDController, p, i, d, max_effort, 0);
 
 	//----- Attitude controller settings -----//
 	p = 6.3; // we may need some expo, large errors are not producing enough effort :()
 	i = 0;
 	d = 0;
 	max_effort = MAX_ANGULAR_RATE_RAD; // attitude controlle produces a rate setpoint
-	_pitch_controller = new controllers::PIDController(p, i, d, max_effort, max_integrator);
-	_roll_controller = new controllers::PIDController(p, i, d, max_effort, max_integrator);
+	_pitch_controller = STATIC_NEW(controllers::PIDController, p, i, d, max_effort, max_integrator);
+	_roll_controller = STATIC_NEW(controllers::PIDController, p, i, d, max_effort, max_integrator);
 }
 
 void AttitudeControl::collect_attitude_data(void)
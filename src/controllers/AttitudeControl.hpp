@@ -42,6 +42,9 @@ public:
 	void collect_attitude_data(void);
 	void collect_attitude_rate_data(void);
 
+	// Blocks until the next filtered gyro sample is published
+	bool wait_for_attitude_rate_data(TickType_t timeout) { return _gyro_sub.wait_for_update(timeout); };
+
 	// RC stuff
 	void get_rc_input(void);
 	void check_for_arm_condition(void);
@@ -22,47 +22,166 @@
 
 #include "DispatchQueue.hpp"
 
+static_assert(MAX_INTERVAL_ITEMS + DISPATCH_LANE_COUNT <= 32, "SystemView user event ids would overlap");
 
-DispatchQueue::DispatchQueue(const std::string name, const PriorityLevel priority,
+DispatchQueue* DispatchQueue::_queues[MAX_DISPATCH_QUEUES] = {};
+size_t DispatchQueue::_queue_count = 0;
+uint8_t DispatchQueue::_next_profile_id = 0;
+
+DispatchQueue::DispatchQueue(const char* name, const PriorityLevel priority,
 							const size_t stack_size)
 	: _name(name)
+	, _interval_dispatcher(this)
 {
 	_mutex = xSemaphoreCreateRecursiveMutex();
 
-	SYS_INFO("DispatchQueue: %s", _name.c_str());
+	register_queue();
 
 	xTaskCreate(reinterpret_cast<void(*)(void*)>(
 				BOUNCE(DispatchQueue, dispatch_thread_handler)),
-				_name.c_str(),
+				_name,
 				stack_size,
 				reinterpret_cast<void*>(this), // pass in the "this" pointer as pvParameters...why?
 				priority,
 				&_task_handle);
+}
+
+#if configSUPPORT_STATIC_ALLOCATION
+DispatchQueue::DispatchQueue(const char* name, const PriorityLevel priority, StackType_t* stack,
+							const size_t stack_size)
+	: _name(name)
+	, _interval_dispatcher(this)
+{
+	_mutex = xSemaphoreCreateRecursiveMutexStatic(&_mutex_buffer);
 
-	// Intialize dispatch timer for interval work -- must come after the DispatchQueue task handle has been created!
-	_interval_dispatcher = new IntervalDispatchScheduler(this);
+	register_queue();
+
+	_task_handle = xTaskCreateStatic(reinterpret_cast<void(*)(void*)>(
+				BOUNCE(DispatchQueue, dispatch_thread_handler)),
+				_name,
+				stack_size,
+				reinterpret_cast<void*>(this),
+				priority,
+				stack,
+				&_task_buffer);
 }
+#endif
 
-void DispatchQueue::dispatch(const fp_t& work)
+void DispatchQueue::register_queue(void)
 {
-	xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
-	_queue.push(work);
-	xSemaphoreGiveRecursive(_mutex);
+	SYS_INFO("DispatchQueue: %s", _name);
 
-	// Wake up worker thread
-	xTaskNotifyGive(_task_handle);
-	return;
+	// Start the DWT cycle counter used to time each job
+	ARM_DEMCR |= ARM_DEMCR_TRCENA;
+	ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+
+	vTaskSuspendAll();
+
+	_profile_id = _next_profile_id++;
+
+	if (_queue_count < MAX_DISPATCH_QUEUES)
+	{
+		_queues[_queue_count++] = this;
+	}
+
+	xTaskResumeAll();
 }
 
-void DispatchQueue::dispatch(fp_t&& work)
+bool DispatchQueue::push_work(QueuedWork&& item, DispatchPriority priority)
 {
-	xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
-	_queue.push(std::move(work));
-	xSemaphoreGiveRecursive(_mutex);
+	Lane& lane = _lanes[static_cast<size_t>(priority)];
+
+	if (!lane.queue.push(std::move(item)))
+	{
+		lane.stats.record_dropped();
+		return false;
+	}
+
+	return true;
+}
+
+bool DispatchQueue::dispatch(const fp_t& work, DispatchPriority priority)
+{
+	return dispatch(fp_t(work), priority);
+}
+
+bool DispatchQueue::dispatch(fp_t&& work, DispatchPriority priority)
+{
+	QueuedWork item;
+	item.work = std::move(work);
+	item.enqueued = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+
+	if (!push_work(std::move(item), priority))
+	{
+		return false;
+	}
 
 	// Wake up worker thread
 	xTaskNotifyGive(_task_handle);
-	return;
+	return true;
+}
+
+bool DispatchQueue::dispatch_from_isr(const fp_t& work, DispatchPriority priority)
+{
+	QueuedWork item;
+	item.work = work;
+	item.enqueued = time::HighPrecisionTimer::Instance()->get_absolute_time_us_from_isr();
+
+	if (!push_work(std::move(item), priority))
+	{
+		return false;
+	}
+
+	notify();
+	return true;
+}
+
+bool DispatchQueue::async_work_pending(void)
+{
+	for (auto& lane : _lanes)
+	{
+		if (!lane.queue.empty())
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Strict priority, except that a lane whose oldest item has waited past the aging
+// threshold is promoted above every lane that has not.
+DispatchQueue::Lane* DispatchQueue::next_lane(abs_time_t now)
+{
+	Lane* highest = nullptr;
+	abs_time_t threshold = _aging_threshold;
+
+	for (auto& lane : _lanes)
+	{
+		QueuedWork* item = lane.queue.front();
+
+		if (item == nullptr)
+		{
+			continue;
+		}
+
+		if (highest == nullptr)
+		{
+			highest = &lane;
+
+			if (threshold == 0)
+			{
+				break;
+			}
+		}
+		else if (now > item->enqueued && now - item->enqueued >= threshold)
+		{
+			lane.stats.aged++;
+			return &lane;
+		}
+	}
+
+	return highest;
 }
 
 void DispatchQueue::notify()
@@ -78,95 +197,190 @@ void DispatchQueue::notify()
 	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
-void DispatchQueue::dispatch_on_interval(const fp_t& work, abs_time_t interval)
+DispatchHandle DispatchQueue::dispatch_on_interval(const fp_t& work, abs_time_t interval, IntervalPolicy policy)
+{
+	return schedule(fp_t(work), interval, 0, policy, false);
+}
+
+DispatchHandle DispatchQueue::dispatch_on_interval(fp_t&& work, abs_time_t interval, IntervalPolicy policy)
 {
+	return schedule(std::move(work), interval, 0, policy, false);
+}
+
+DispatchHandle DispatchQueue::dispatch_after(const fp_t& work, abs_time_t delay_us)
+{
+	return schedule(fp_t(work), delay_us, delay_us, IntervalPolicy::RELATIVE, true);
+}
+
+DispatchHandle DispatchQueue::dispatch_after(fp_t&& work, abs_time_t delay_us)
+{
+	return schedule(std::move(work), delay_us, delay_us, IntervalPolicy::RELATIVE, true);
+}
+
+DispatchHandle DispatchQueue::schedule(fp_t&& work, abs_time_t interval, abs_time_t delay,
+	IntervalPolicy policy, bool one_shot)
+{
+	// A zero period would keep the item due forever and starve everything else
+	if (!one_shot && interval == 0)
+	{
+		SYS_INFO("DispatchQueue: %s interval must be > 0", _name);
+		return DispatchHandle();
+	}
+
 	xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
 
 	// Push item into an interval queue -- must disable interrupts since this is shared w/ timer isr.
 
 	taskENTER_CRITICAL();
 
-	_interval_dispatcher->disable_scheduler();
-	_interval_dispatcher->add_item(work, interval);
-	_interval_dispatcher->invoke_scheduler();
-	_interval_dispatcher->enable_scheduler();
+	_interval_dispatcher.disable_scheduler();
+	auto handle = _interval_dispatcher.add_item(std::move(work), interval, delay, policy, one_shot);
+	_interval_dispatcher.invoke_scheduler();
+	_interval_dispatcher.enable_scheduler();
 
 	taskEXIT_CRITICAL();
 
 	xSemaphoreGiveRecursive(_mutex);
+
+	if (!handle)
+	{
+		SYS_INFO("DispatchQueue: %s interval list full", _name);
+	}
+
+	return handle;
 }
-void DispatchQueue::dispatch_on_interval(fp_t&& work, abs_time_t interval)
+
+bool DispatchQueue::cancel(const DispatchHandle& handle)
 {
-	xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
+	if (handle._queue != this)
+	{
+		return false;
+	}
 
-	// Push item into an interval queue -- must disable interrupts since this is shared w/ timer isr.
+	xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
 
 	taskENTER_CRITICAL();
 
-	_interval_dispatcher->disable_scheduler();
-	_interval_dispatcher->add_item(std::move(work), interval);
-	_interval_dispatcher->invoke_scheduler();
-	_interval_dispatcher->enable_scheduler();
+	_interval_dispatcher.disable_scheduler();
+	bool removed = _interval_dispatcher.remove_item(handle._slot, handle._generation);
+	_interval_dispatcher.invoke_scheduler();
+	_interval_dispatcher.enable_scheduler();
 
 	taskEXIT_CRITICAL();
 
 	xSemaphoreGiveRecursive(_mutex);
+
+	return removed;
 }
 
-void DispatchQueue::dispatch_thread_handler(void)
+bool DispatchQueue::change_interval(const DispatchHandle& handle, abs_time_t interval)
 {
+	if (handle._queue != this)
+	{
+		return false;
+	}
+
 	xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
 
+	taskENTER_CRITICAL();
+
+	_interval_dispatcher.disable_scheduler();
+	bool changed = _interval_dispatcher.change_interval(handle._slot, handle._generation, interval);
+	_interval_dispatcher.invoke_scheduler();
+	_interval_dispatcher.enable_scheduler();
+
+	taskEXIT_CRITICAL();
+
+	xSemaphoreGiveRecursive(_mutex);
+
+	return changed;
+}
+
+bool DispatchHandle::cancel(void) const
+{
+	return _queue != nullptr && _queue->cancel(*this);
+}
+
+bool DispatchHandle::change_interval(abs_time_t interval) const
+{
+	return _queue != nullptr && _queue->change_interval(*this, interval);
+}
+
+void DispatchQueue::dispatch_thread_handler(void)
+{
 	do
 	{
 		// Do work while the queue is not empty OR if we have an interval item ready to run
 		// TODO: clean up -- break apart and simplify logic
-		if(!_should_exit && (!_queue.empty() || _interval_dispatcher->item_ready()))
+		if(!_should_exit && (async_work_pending() || _interval_dispatcher.item_ready()))
 		{
 			// First we check to see if there's an interval item ready to run
-			if (_interval_dispatcher->item_ready())
+			if (_interval_dispatcher.item_ready())
 			{
 				taskENTER_CRITICAL();
 
 				// Disable the scheduler
-				_interval_dispatcher->disable_scheduler();
+				_interval_dispatcher.disable_scheduler();
 
 				// Grab the next ready to run interval item
-				auto* item = _interval_dispatcher->get_ready_item();
+				auto* item = _interval_dispatcher.get_ready_item();
+
+				// Run a copy -- the item may be cancelled, or freed if it is one-shot,
+				// before the work returns
+				fp_t work = item->work;
+				uint8_t slot = _interval_dispatcher.slot_of(item);
+				uint16_t generation = item->generation;
+				bool one_shot = item->one_shot;
 
 				// Reschedule based on entrance time to ensure interval precision
-				_interval_dispatcher->reschedule_item(item);
-				_interval_dispatcher->invoke_scheduler();
-				_interval_dispatcher->enable_scheduler();
+				_interval_dispatcher.reschedule_item(item);
+				_interval_dispatcher.invoke_scheduler();
+				_interval_dispatcher.enable_scheduler();
 
 				taskEXIT_CRITICAL();
 
-				item->work();
+				unsigned event_id = (_profile_id << 5) | slot;
+				SEGGER_SYSVIEW_OnUserStart(event_id);
+				uint32_t start = ARM_DWT_CYCCNT;
+
+				work();
+
+				uint32_t cycles = ARM_DWT_CYCCNT - start;
+				SEGGER_SYSVIEW_OnUserStop(event_id);
+
+				// Dropped if the item was cancelled while it ran
+				_interval_dispatcher.record_execution(slot, generation, one_shot, cycles);
 			}
 			else
 			// Otherwise we service the async queue
 			{
-				auto work = std::move(_queue.front());
-				_queue.pop();
+				auto now = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+				Lane* lane = next_lane(now);
+				QueuedWork item;
 
-				xSemaphoreGiveRecursive(_mutex);
+				if (lane != nullptr && lane->queue.pop(item))
+				{
+					lane->stats.record_delay(now > item.enqueued ? now - item.enqueued : 0);
 
-				// Run function
-				work();
+					unsigned event_id = (_profile_id << 5) | (MAX_INTERVAL_ITEMS + (lane - _lanes));
+					SEGGER_SYSVIEW_OnUserStart(event_id);
+					uint32_t start = ARM_DWT_CYCCNT;
+
+					// Run function
+					item.work();
 
-				xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
+					lane->stats.execution.record(ARM_DWT_CYCCNT - start);
+					SEGGER_SYSVIEW_OnUserStop(event_id);
+				}
 			}
 		}
 		// Our queue is empty -- go to sleep until we have work.
 		else if(!_should_exit)
 		{
-			xSemaphoreGiveRecursive(_mutex);
-
 			// Wait for new work - clear flags on exit
 			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
 			// We are awake! Time to do some work...
-			xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
 		}
 		else
 		{
@@ -175,9 +389,6 @@ void DispatchQueue::dispatch_thread_handler(void)
 
 	} while (!_should_exit);
 
-	// We were holding the mutex after we woke up
-	xSemaphoreGiveRecursive(_mutex);
-
 	// NOTE: The idle task is responsible for freeing the RTOS kernel allocated
 	// memory from tasks that have been deleted. It is therefore important that
 	// the idle task is not starved of microcontroller processing time if your
@@ -189,8 +400,26 @@ void DispatchQueue::dispatch_thread_handler(void)
  	return;
 }
 
+bool DispatchQueue::profile(size_t slot, IntervalProfile& profile) const
+{
+	return _interval_dispatcher.profile(slot, profile);
+}
+
 DispatchQueue::~DispatchQueue(void)
 {
+	vTaskSuspendAll();
+
+	for (size_t i = 0; i < _queue_count; i++)
+	{
+		if (_queues[i] == this)
+		{
+			_queues[i] = _queues[--_queue_count];
+			break;
+		}
+	}
+
+	xTaskResumeAll();
+
 	_should_exit = true;
 
 	join_worker_thread();
@@ -215,55 +444,273 @@ void DispatchQueue::join_worker_thread(void)
 }
 
 //----- INTERVAL DISPATCHER -----//
-void IntervalDispatchScheduler::add_item(const fp_t& work, abs_time_t interval)
+DispatchHandle IntervalDispatchScheduler::add_item(fp_t&& work, abs_time_t interval, abs_time_t delay,
+	IntervalPolicy policy, bool one_shot)
+{
+	if (_count == MAX_INTERVAL_ITEMS || (!one_shot && interval == 0))
+	{
+		return DispatchHandle();
+	}
+
+	// Any slot that is not in the heap is free
+	size_t slot = 0;
+	while (_items[slot].heap_index != IntervalWork::NOT_SCHEDULED)
+	{
+		slot++;
+	}
+
+	auto now = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+
+	IntervalWork* item = &_items[slot];
+	item->work = std::move(work);
+	item->interval = interval;
+	item->deadline = now + delay;
+	item->policy = policy;
+	item->one_shot = one_shot;
+	item->stats = IntervalStats();
+
+	item->heap_index = _count;
+	_heap[_count] = item;
+	_count++;
+	sift_up(item->heap_index);
+
+	return DispatchHandle(_dispatcher, slot, item->generation);
+}
+
+bool IntervalDispatchScheduler::remove_item(uint8_t slot, uint16_t generation)
+{
+	IntervalWork* item = find_item(slot, generation);
+
+	if (item == nullptr)
+	{
+		return false;
+	}
+
+	remove_from_heap(item->heap_index);
+	return true;
+}
+
+bool IntervalDispatchScheduler::change_interval(uint8_t slot, uint16_t generation, abs_time_t interval)
+{
+	IntervalWork* item = find_item(slot, generation);
+
+	if (item == nullptr || (!item->one_shot && interval == 0))
+	{
+		return false;
+	}
+
+	// Swap the period that is already running for the new one
+	abs_time_t previous = item->deadline > item->interval ? item->deadline - item->interval : 0;
+	item->deadline = previous + interval;
+	item->interval = interval;
+
+	sift_up(item->heap_index);
+	sift_down(item->heap_index);
+
+	return true;
+}
+
+bool IntervalDispatchScheduler::record_execution(uint8_t slot, uint16_t generation, bool one_shot,
+	uint32_t cycles)
+{
+	taskENTER_CRITICAL();
+
+	IntervalWork* item = nullptr;
+
+	if (one_shot)
+	{
+		// No next deadline to miss
+		_one_shot_stats.execution.record(cycles);
+	}
+	else
+	{
+		item = find_item(slot, generation);
+
+		if (item != nullptr)
+		{
+			item->stats.record_execution(cycles, item->interval);
+		}
+	}
+
+	taskEXIT_CRITICAL();
+
+	return one_shot || item != nullptr;
+}
+
+bool IntervalDispatchScheduler::profile(size_t slot, IntervalProfile& profile) const
+{
+	if (slot >= MAX_INTERVAL_ITEMS || _items[slot].heap_index == IntervalWork::NOT_SCHEDULED)
+	{
+		return false;
+	}
+
+	const IntervalWork& item = _items[slot];
+
+	profile.slot = slot;
+	profile.one_shot = item.one_shot;
+	profile.interval = item.interval;
+	profile.stats = item.stats;
+
+	return true;
+}
+
+IntervalWork* IntervalDispatchScheduler::find_item(uint8_t slot, uint16_t generation)
 {
-	auto deadline_now = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+	if (slot >= MAX_INTERVAL_ITEMS)
+	{
+		return nullptr;
+	}
+
+	IntervalWork* item = &_items[slot];
 
-	_interval_list.push_back(IntervalWork(work, interval, deadline_now));
+	if (item->heap_index == IntervalWork::NOT_SCHEDULED || item->generation != generation)
+	{
+		return nullptr;
+	}
+
+	return item;
 }
 
-void IntervalDispatchScheduler::add_item(fp_t&& work, abs_time_t interval)
+void IntervalDispatchScheduler::remove_from_heap(size_t index)
 {
-	auto deadline_now = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+	IntervalWork* item = _heap[index];
+
+	_count--;
 
-	_interval_list.push_back(IntervalWork(std::move(work), interval, deadline_now));
+	// Fill the hole with the last node and restore the heap from there
+	if (index != _count)
+	{
+		IntervalWork* moved = _heap[_count];
+
+		_heap[index] = moved;
+		moved->heap_index = index;
+		sift_up(index);
+		sift_down(moved->heap_index);
+	}
+
+	_heap[_count] = nullptr;
+
+	item->work = nullptr;
+	item->heap_index = IntervalWork::NOT_SCHEDULED;
+	item->generation++;
 }
 
+// Only ever called on the item at the top of the heap
 void IntervalDispatchScheduler::reschedule_item(IntervalWork* item)
 {
 	auto now = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
 
-	item->deadline = now + item->interval;
+	abs_time_t lateness = now > item->deadline ? now - item->deadline : 0;
+
+	item->stats.record_lateness(lateness, item->interval);
+
+	if (item->one_shot)
+	{
+		// The slot is freed here, its stats live on in the one-shot bucket. There is no
+		// period to overrun.
+		_one_shot_stats.record_lateness(lateness, time::MAX_TIME);
+		remove_from_heap(item->heap_index);
+		return;
+	}
+
+	switch (item->policy)
+	{
+	case IntervalPolicy::RELATIVE:
+		item->deadline = now + item->interval;
+		break;
+
+	case IntervalPolicy::CATCH_UP:
+		// Still in the past if we overran -- the item simply runs again right away
+		item->deadline += item->interval;
+		break;
+
+	case IntervalPolicy::SKIP:
+		item->deadline += item->interval;
+
+		// Drop every period we have already missed but stay on the original phase
+		if (item->deadline <= now && item->interval > 0)
+		{
+			abs_time_t missed = (now - item->deadline) / item->interval + 1;
+			item->deadline += missed * item->interval;
+			item->stats.skipped += missed;
+		}
+		break;
+	}
+
+	sift_down(item->heap_index);
 }
 
 // MUST ONLY BE CALLED WHEN INTERRUPTS ARE DISABLED
 void IntervalDispatchScheduler::invoke_scheduler(void)
 {
-	if (_interval_list.empty())
+	if (_count == 0)
 	{
+		time::HighPrecisionTimer::Instance()->clear_compare(_timer_client);
 		return;
 	}
 
-	if (_next_item_to_run == nullptr)
+	auto now = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+
+	// Always arm the compare. A deadline that has already passed pends the timer ISR
+	// straight away, so the worker is notified even when the item was added from another
+	// task while the worker is blocked.
+	time::HighPrecisionTimer::Instance()->set_compare(_timer_client, _heap[0]->deadline);
+
+	// Lets the worker run it without waiting for the ISR if it is the caller
+	if (now >= _heap[0]->deadline)
 	{
-		_next_item_to_run = &(*_interval_list.begin());
+		_an_item_is_ready = true;
 	}
+}
 
-	auto now = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+void IntervalDispatchScheduler::swap_nodes(size_t a, size_t b)
+{
+	std::swap(_heap[a], _heap[b]);
+	_heap[a]->heap_index = a;
+	_heap[b]->heap_index = b;
+}
 
-	// Iterate over the list of interval items and mark if ready
-	for (auto &it : _interval_list)
+void IntervalDispatchScheduler::sift_up(size_t index)
+{
+	while (index > 0)
 	{
-		if (it.deadline < _next_item_to_run->deadline)
+		size_t parent = (index - 1) / 2;
+
+		if (_heap[parent]->deadline <= _heap[index]->deadline)
 		{
-			_next_item_to_run = &it;
+			break;
 		}
+
+		swap_nodes(parent, index);
+		index = parent;
 	}
+}
 
-	// If the deadline has already passed, raise _an_item_is_ready flag
-	if (now >= _next_item_to_run->deadline)
+void IntervalDispatchScheduler::sift_down(size_t index)
+{
+	for (;;)
 	{
-		_an_item_is_ready = true;
+		size_t smallest = index;
+		size_t left = 2 * index + 1;
+		size_t right = left + 1;
+
+		if (left < _count && _heap[left]->deadline < _heap[smallest]->deadline)
+		{
+			smallest = left;
+		}
+
+		if (right < _count && _heap[right]->deadline < _heap[smallest]->deadline)
+		{
+			smallest = right;
+		}
+
+		if (smallest == index)
+		{
+			break;
+		}
+
+		swap_nodes(smallest, index);
+		index = smallest;
 	}
 }
 
@@ -271,13 +718,13 @@ void IntervalDispatchScheduler::disable_scheduler(void)
 {
 	_an_item_is_ready = false;
 	// Tell timer ISR to not call the scheduler callback
-	time::HighPrecisionTimer::Instance()->disable_callback();
+	time::HighPrecisionTimer::Instance()->disable_callback(_timer_client);
 }
 
 void IntervalDispatchScheduler::enable_scheduler(void)
 {
-	// Tell timer ISR to not call the scheduler callback
-	time::HighPrecisionTimer::Instance()->enable_callback();
+	// Let the timer ISR call the scheduler callback again
+	time::HighPrecisionTimer::Instance()->enable_callback(_timer_client);
 }
 
 
@@ -293,23 +740,37 @@ IntervalDispatchScheduler::IntervalDispatchScheduler(DispatchQueue* dispatcher)
 	}
 
 	// Register the scheduling callback with the timer instance
-	time::HighPrecisionTimer::Instance()->register_overflow_callback<IntervalDispatchScheduler>(this);
+	_timer_client = time::HighPrecisionTimer::Instance()->register_deadline_callback<IntervalDispatchScheduler>(this);
 
 	taskEXIT_CRITICAL();
 }
 
-void IntervalDispatchScheduler::timer_overflow_callback(void)
+IntervalDispatchScheduler::~IntervalDispatchScheduler(void)
+{
+	taskENTER_CRITICAL();
+
+	time::HighPrecisionTimer::Instance()->unregister_client(_timer_client);
+
+	taskEXIT_CRITICAL();
+}
+
+void IntervalDispatchScheduler::timer_deadline_callback(void)
 {
 	// Notify the dispatcher that an interval item is ready to run
-	if (_dispatcher != nullptr && _next_item_to_run != nullptr)
+	if (_dispatcher != nullptr && _count > 0)
 	{
 		auto now = time::HighPrecisionTimer::Instance()->get_absolute_time_us_from_isr();
 
-		if (now >= _next_item_to_run->deadline)
+		if (now >= _heap[0]->deadline)
 		{
 			// This function will unblock the DispatchQueue to run an Interval item
 			_an_item_is_ready = true;
 			_dispatcher->notify();
 		}
+		else
+		{
+			// The head changed after the compare was armed
+			time::HighPrecisionTimer::Instance()->set_compare(_timer_client, _heap[0]->deadline);
+		}
 	}
 }
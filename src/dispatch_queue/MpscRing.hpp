@@ -0,0 +1,141 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Bounded multi-producer single-consumer ring. Producers may be tasks or ISRs and never
+// block or disable interrupts: each one claims a cell with a compare-and-swap on the head
+// and then publishes it through the cell's sequence number. A producer that is preempted
+// between the two only holds up the consumer, never another producer.
+//
+// Based on Dmitry Vyukov's bounded MPMC queue, reduced to a single consumer.
+template <typename T, size_t N>
+class MpscRing
+{
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of 2");
+
+public:
+	MpscRing()
+	{
+		for (size_t i = 0; i < N; i++)
+		{
+			_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// Returns false if the ring is full -- safe to call from an ISR
+	template <typename U>
+	bool push(U&& item)
+	{
+		Cell* cell;
+		uint32_t position = _head.load(std::memory_order_relaxed);
+
+		for (;;)
+		{
+			cell = &_cells[position & (N - 1)];
+			uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+			int32_t difference = static_cast<int32_t>(sequence - position);
+
+			if (difference == 0)
+			{
+				// The cell is free, try to claim it
+				if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				// The consumer has not emptied this cell yet
+				return false;
+			}
+			else
+			{
+				// Another producer got here first
+				position = _head.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->data = std::forward<U>(item);
+		cell->sequence.store(position + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Only ever called by the single consumer
+	bool pop(T& item)
+	{
+		Cell* cell = &_cells[_tail & (N - 1)];
+		uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+
+		// Empty, or the next producer in line has not finished writing yet
+		if (static_cast<int32_t>(sequence - (_tail + 1)) < 0)
+		{
+			return false;
+		}
+
+		item = std::move(cell->data);
+		cell->sequence.store(_tail + N, std::memory_order_release);
+		_tail++;
+
+		return true;
+	}
+
+	// Only ever called by the single consumer -- the item stays in the ring until pop()
+	T* front(void)
+	{
+		Cell* cell = &_cells[_tail & (N - 1)];
+		uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+
+		if (static_cast<int32_t>(sequence - (_tail + 1)) < 0)
+		{
+			return nullptr;
+		}
+
+		return &cell->data;
+	}
+
+	bool empty(void) const
+	{
+		uint32_t sequence = _cells[_tail & (N - 1)].sequence.load(std::memory_order_acquire);
+
+		return static_cast<int32_t>(sequence - (_tail + 1)) < 0;
+	}
+
+	static constexpr size_t capacity(void) { return N; };
+
+private:
+	struct Cell
+	{
+		std::atomic<uint32_t> sequence;
+		T data;
+	};
+
+	Cell _cells[N];
+	std::atomic<uint32_t> _head {0}; // next cell a producer claims
+	uint32_t _tail = 0; // next cell the consumer reads
+};
@@ -54,16 +54,26 @@
 
 void Estimator::collect_sensor_data(void)
 {
+	// Average every gyro sample since the last estimate -- multiplied by dt this is
+	// the same as integrating each 1kHz sample instead of just the newest one.
 	if (_gyro_sub.updated())
 	{
-		auto data = _gyro_sub.get();
-		auto x = data.x;
-		auto y = data.y;
-		auto z = data.z;
-
-		_gyro_xyz.x() = x;
-		_gyro_xyz.y() = y;
-		_gyro_xyz.z() = z;
+		gyro_raw_data_s batch[messenger::topic_traits<gyro_raw_data_s>::depth];
+		size_t count = _gyro_sub.get_batch(batch, sizeof(batch)/sizeof(batch[0]));
+
+		Vector3f sum = Vector3f::Zero();
+
+		for (size_t i = 0; i < count; i++)
+		{
+			sum.x() += batch[i].x;
+			sum.y() += batch[i].y;
+			sum.z() += batch[i].z;
+		}
+
+		if (count > 0)
+		{
+			_gyro_xyz = sum / count;
+		}
 	}
 
 	if (_accel_sub.updated())
@@ -22,15 +22,7 @@
 
 #include <board_config.hpp>
 #include <timers/Time.hpp>
-
-extern void led_task(void* args);
-extern void frsky_task(void* args);
-extern void estimator_task(void* args);
-extern void imu_task(void* args);
-extern void sanity_idle_task(void* args);
-extern void dispatch_test_task(void* args);
-extern void shell_task(void* args);
-extern void controller_task(void* args);
+#include <task_table.hpp>
 
 extern const uint8_t FreeRTOSDebugConfig[];
 
@@ -42,20 +34,9 @@ extern "C" int main()
 	// Initialize SystemView
 	SEGGER_SYSVIEW_Conf();
 
-	// SystemView will mark unintrumented work as "idle", which is very misleading! Keep this in here.
-	xTaskCreate(sanity_idle_task, "sanity_idle_task", configMINIMAL_STACK_SIZE, NULL, PriorityLevel::LOWEST, NULL);
-	xTaskCreate(shell_task, "shell_task", configMINIMAL_STACK_SIZE*4, NULL, PriorityLevel::LOWEST+1, NULL);
-
-	xTaskCreate(led_task, "led_task", configMINIMAL_STACK_SIZE * 3, NULL, PriorityLevel::LOWEST+1, NULL);
-	// 	ESTIMATOR TASK SPAWNS A THREAD!! WTF! WHY??
-	xTaskCreate(estimator_task, "estimator", configMINIMAL_STACK_SIZE * 3, NULL, PriorityLevel::LOWEST+1, NULL);
-
-	xTaskCreate(frsky_task, "frsky", configMINIMAL_STACK_SIZE * 4, NULL, PriorityLevel::LOWEST+2, NULL);
-
-	xTaskCreate(dispatch_test_task, "dispatch_test_task", configMINIMAL_STACK_SIZE * 5, NULL, PriorityLevel::HIGHEST, NULL);
-	xTaskCreate(imu_task, "imu_task", configMINIMAL_STACK_SIZE * 5, NULL, PriorityLevel::HIGHEST-1, NULL);
-	xTaskCreate(controller_task, "controller_task", configMINIMAL_STACK_SIZE * 5, NULL, PriorityLevel::HIGHEST-1, NULL);
-
+	// SystemView will mark unintrumented work as "idle", which is very misleading! The
+	// sanity_idle_task in the task table takes care of that, keep it in there.
+	board::create_tasks();
 
 	vTaskStartScheduler();
 
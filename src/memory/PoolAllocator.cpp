@@ -0,0 +1,211 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <PoolAllocator.hpp>
+#include <interrupt_lock.hpp>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+namespace memory
+{
+
+// A free block holds the pointer to the next one. Blocks that have never been handed
+// out are not on the list -- they are taken in order from next_unused, so the pools
+// need no constructor and work for allocations made during static initialization.
+struct FreeBlock
+{
+	FreeBlock* next;
+};
+
+struct BlockPool
+{
+	uint8_t* storage;
+	size_t block_size;
+	size_t blocks;
+
+	FreeBlock* free_list;
+	size_t next_unused;
+	size_t in_use;
+	size_t high_water;
+	uint32_t failures;
+
+	bool owns(const void* ptr) const
+	{
+		auto address = static_cast<const uint8_t*>(ptr);
+		return address >= storage && address < storage + block_size * blocks;
+	}
+
+	void* allocate(void)
+	{
+		void* block = nullptr;
+
+		if (free_list != nullptr)
+		{
+			block = free_list;
+			free_list = free_list->next;
+		}
+		else if (next_unused < blocks)
+		{
+			block = storage + block_size * next_unused++;
+		}
+		else
+		{
+			return nullptr;
+		}
+
+		if (++in_use > high_water)
+		{
+			high_water = in_use;
+		}
+
+		return block;
+	}
+
+	void release(void* ptr)
+	{
+		auto block = static_cast<FreeBlock*>(ptr);
+		block->next = free_list;
+		free_list = block;
+		in_use--;
+	}
+};
+
+#define MEMORY_POOL_STORAGE(size, blocks) alignas(8) static uint8_t pool_##size[size * blocks];
+MEMORY_POOLS(MEMORY_POOL_STORAGE)
+#undef MEMORY_POOL_STORAGE
+
+#define MEMORY_POOL_ENTRY(size, blocks) { pool_##size, size, blocks, nullptr, 0, 0, 0, 0 },
+static BlockPool POOLS[POOL_COUNT] =
+{
+	MEMORY_POOLS(MEMORY_POOL_ENTRY)
+};
+#undef MEMORY_POOL_ENTRY
+
+static uint32_t _large_allocations = 0;
+static uint32_t _exhausted_allocations = 0;
+
+// Short and bounded -- at most one pass over POOL_COUNT classes. Static constructors
+// allocate before the scheduler runs, so this masks interrupts rather than entering a
+// FreeRTOS critical section.
+static void* allocate_from_pools(size_t size)
+{
+	InterruptLock lock;
+
+	bool fits = false;
+
+	for (auto& pool : POOLS)
+	{
+		if (size > pool.block_size)
+		{
+			continue;
+		}
+
+		void* block = pool.allocate();
+
+		// Try the next class up if the best fit is exhausted
+		if (block == nullptr && !fits)
+		{
+			pool.failures++;
+		}
+
+		fits = true;
+
+		if (block != nullptr)
+		{
+			return block;
+		}
+	}
+
+	if (fits)
+	{
+		_exhausted_allocations++;
+	}
+	else
+	{
+		_large_allocations++;
+	}
+
+	return nullptr;
+}
+
+void* allocate(size_t size)
+{
+	void* block = allocate_from_pools(size);
+
+	if (block == nullptr)
+	{
+		block = pvPortMalloc(size);
+	}
+
+	return block;
+}
+
+void deallocate(void* ptr)
+{
+	if (ptr == nullptr)
+	{
+		return;
+	}
+
+	for (auto& pool : POOLS)
+	{
+		if (pool.owns(ptr))
+		{
+			InterruptLock lock;
+			pool.release(ptr);
+			return;
+		}
+	}
+
+	vPortFree(ptr);
+}
+
+bool pool_stats(size_t pool, PoolStats& stats)
+{
+	if (pool >= POOL_COUNT)
+	{
+		return false;
+	}
+
+	InterruptLock lock;
+
+	stats.block_size = POOLS[pool].block_size;
+	stats.blocks = POOLS[pool].blocks;
+	stats.in_use = POOLS[pool].in_use;
+	stats.high_water = POOLS[pool].high_water;
+	stats.failures = POOLS[pool].failures;
+
+	return true;
+}
+
+uint32_t large_allocations(void)
+{
+	return _large_allocations;
+}
+
+uint32_t exhausted_allocations(void)
+{
+	return _exhausted_allocations;
+}
+
+} // end namespace memory
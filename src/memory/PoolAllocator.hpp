@@ -0,0 +1,66 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size classes served from fixed blocks: X(block size in bytes, number of blocks).
+// Sizes must be ascending multiples of 8.
+#define MEMORY_POOLS(X) \
+	X(16,	64) \
+	X(32,	48) \
+	X(64,	32) \
+	X(128,	16) \
+	X(256,	8)
+
+namespace memory
+{
+
+#define MEMORY_POOL_COUNT(size, blocks) + 1
+static constexpr size_t POOL_COUNT = 0 MEMORY_POOLS(MEMORY_POOL_COUNT);
+#undef MEMORY_POOL_COUNT
+
+struct PoolStats
+{
+	size_t block_size;
+	size_t blocks;
+	size_t in_use;
+	size_t high_water; // most blocks ever in use at once
+	uint32_t failures; // requests this class was the best fit for but had no free block
+};
+
+// O(1) allocate and free from the smallest size class that fits. Requests larger than
+// the largest class, or made while every fitting class is exhausted, go to heap_4.
+void* allocate(size_t size);
+void deallocate(void* ptr);
+
+// Snapshot of one size class, false if pool is out of range
+bool pool_stats(size_t pool, PoolStats& stats);
+
+// Allocations that ended up in heap_4 because they were too large, and because the
+// pools were exhausted
+uint32_t large_allocations(void);
+uint32_t exhausted_allocations(void);
+
+} // end namespace memory
@@ -0,0 +1,109 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <Messenger.hpp>
+
+namespace messenger
+{
+
+#define MESSENGER_TOPIC_INFO(type, depth, kind) { #type, sizeof(type), depth, TopicKind::kind },
+const TopicInfo TOPIC_TABLE[TOPIC_COUNT] =
+{
+	MESSENGER_TOPICS(MESSENGER_TOPIC_INFO)
+};
+#undef MESSENGER_TOPIC_INFO
+
+TopicStats TOPIC_STATS[TOPIC_COUNT] = {};
+
+TaskHandle_t TopicRegistry::_tasks[MAX_WAITING_TASKS] = {};
+uint8_t TopicRegistry::_refs[TOPIC_COUNT][MAX_WAITING_TASKS] = {};
+volatile uint32_t TopicRegistry::_topic_waiters[TOPIC_COUNT] = {};
+
+bool TopicRegistry::add_waiter(TopicId topic, TaskHandle_t task)
+{
+	bool added = false;
+
+	taskENTER_CRITICAL();
+
+	// Find the slot this task already owns, otherwise the first free one
+	int slot = -1;
+	for (size_t i = 0; i < MAX_WAITING_TASKS; i++)
+	{
+		if (_tasks[i] == task)
+		{
+			slot = i;
+			break;
+		}
+		else if (_tasks[i] == nullptr && slot < 0)
+		{
+			slot = i;
+		}
+	}
+
+	if (slot >= 0)
+	{
+		_tasks[slot] = task;
+		_refs[topic][slot]++;
+		_topic_waiters[topic] |= 1UL << slot;
+		added = true;
+	}
+
+	taskEXIT_CRITICAL();
+
+	return added;
+}
+
+void TopicRegistry::remove_waiter(TopicId topic, TaskHandle_t task)
+{
+	taskENTER_CRITICAL();
+
+	for (size_t slot = 0; slot < MAX_WAITING_TASKS; slot++)
+	{
+		if (_tasks[slot] != task || _refs[topic][slot] == 0)
+		{
+			continue;
+		}
+
+		if (--_refs[topic][slot] == 0)
+		{
+			_topic_waiters[topic] &= ~(1UL << slot);
+
+			// Release the task slot once it waits on nothing
+			bool in_use = false;
+			for (size_t t = 0; t < TOPIC_COUNT; t++)
+			{
+				in_use |= _refs[t][slot] != 0;
+			}
+
+			if (!in_use)
+			{
+				_tasks[slot] = nullptr;
+			}
+		}
+
+		break;
+	}
+
+	taskEXIT_CRITICAL();
+}
+
+} // end namespace messenger
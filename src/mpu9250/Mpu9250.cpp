@@ -22,6 +22,15 @@
 
 #include <board_config.hpp>
 #include <Mpu9250.hpp>
+#include <CalibrationStore.hpp>
+
+Mpu9250* Mpu9250::_sampling_instance = nullptr;
+
+static_assert(sizeof(gyro_batch_s::x) / sizeof(float) == MAX_GYRO_BATCH, "gyro_batch.msg holds MAX_GYRO_BATCH samples");
+
+// The FIFO timestamps follow the ODR and are only pulled towards the measured time, an
+// error bigger than this means frames were lost and they start over
+static constexpr int64_t FIFO_RESYNC_US = 1000;
 
 bool Mpu9250::probe(void)
 {
@@ -46,6 +55,14 @@ uint8_t Mpu9250::read_register(uint8_t reg)
 	return recv_buf;
 }
 
+void Mpu9250::read_registers(uint8_t reg, uint8_t* buf, size_t count)
+{
+	// The register address auto-increments for as long as CS is held
+	uint8_t send_buf = reg | 1<<7;
+
+	_interface->transfer(&send_buf, 1, buf, count);
+}
+
 void Mpu9250::write_register(uint8_t addr, uint8_t val)
 {
 	uint8_t send_buf[2] = {addr, val};
@@ -68,8 +85,9 @@ void Mpu9250::initialize_registers(void)
 	// User control
 	write_register(address::USER_CTRL, value::BIT_I2C_IF_DIS | value::BIT_SIG_COND_RST);
 
-	// Interrupt enable
-	write_register(address::INT_ENABLE, value::INT_DISABLE);
+	// Interrupt -- a pulse on INT for every new sample
+	write_register(address::INT_PIN_BYPASS_ENABLE_CONFIG, value::INT_ANYRD_2CLEAR);
+	write_register(address::INT_ENABLE, value::RAW_RDY_EN);
 
 	// Sensors
 	write_register(address::GYRO_CONFIG, value::GYRO_DLPF_2000_DPS);
@@ -115,9 +133,16 @@ bool Mpu9250::validate_registers(void)
 		return false;
 	}
 
-	// Interrupt enable
+	// Interrupt
+	reg_val = read_register(address::INT_PIN_BYPASS_ENABLE_CONFIG);
+	if (reg_val != value::INT_ANYRD_2CLEAR)
+	{
+		SYS_INFO("INT_PIN_CFG");
+		return false;
+	}
+
 	reg_val = read_register(address::INT_ENABLE);
-	if (reg_val != value::INT_DISABLE)
+	if (reg_val != value::RAW_RDY_EN)
 	{
 		SYS_INFO("INT_ENABLE");
 		return false;
@@ -263,52 +288,209 @@ bool Mpu9250::new_data_available(void)
 
 void Mpu9250::collect_data(void)
 {
-	uint8_t* byte_data = reinterpret_cast<uint8_t*>(&_sensor_data);
+	read_registers(address::ACCEL_XOUT_H, _raw, BURST_READ_BYTES);
+
+	update_calibration();
+	decode_sample(_raw);
+}
+
+void Mpu9250::start_sampling(TaskHandle_t task)
+{
+	_sampling_task = task;
+	_sampling_instance = this;
+
+	// The same burst as collect_data(), the bytes after the address are don't care
+	memset(_burst_tx, 0xFF, sizeof(_burst_tx));
+	_burst_tx[0] = address::ACCEL_XOUT_H | 1<<7;
+
+	pinMode(mpu9250_spi::DRDY, INPUT);
+	attachInterrupt(mpu9250_spi::DRDY, data_ready_isr, RISING);
+}
+
+bool Mpu9250::take_sample(abs_time_t& timestamp)
+{
+	taskENTER_CRITICAL();
+
+	int8_t ready = _burst_ready;
+	_burst_ready = -1;
+	_burst_reading = ready;
+
+	taskEXIT_CRITICAL();
+
+	if (ready < 0)
+	{
+		return false;
+	}
+
+	update_calibration();
+
+	// The DMA fills the other buffer meanwhile, a burst that would land in this one is dropped
+	timestamp = _burst_timestamp[ready];
+	decode_sample(&_burst_rx[ready][BURST_RX_OFFSET + 1]);
+
+	_burst_reading = -1;
+
+	return true;
+}
+
+void Mpu9250::data_ready_isr(void)
+{
+	Mpu9250* self = _sampling_instance;
+	uint8_t index = self->_burst_write;
+
+	// Both buffers are taken, the task is still decoding the one we'd write to
+	if (index == self->_burst_reading)
+	{
+		self->_missed_samples++;
+		return;
+	}
 
-	// Accel (xyz)   temp(c)   Gyro(xyz)   Mag (st1, xyz, st2)
-	static constexpr size_t bytes_to_read = sizeof(SensorDataPacked) - 2; // 2 bytes of padding
+	// The sample time is the edge, not when the read completes
+	self->_burst_timestamp[index] = time::HighPrecisionTimer::Instance()->get_absolute_time_us_from_isr();
 
-	for (size_t i = 0; i < bytes_to_read; i++)
+	bool started = self->_interface->transfer_async(self->_burst_tx, &self->_burst_rx[index][BURST_RX_OFFSET],
+		sizeof(self->_burst_tx), [self] { self->burst_complete_isr(); });
+
+	// The bus is still busy with something else
+	if (!started)
 	{
-		// Start at base address and increment over all registers we are interested in.
-		byte_data[i] = read_register(address::ACCEL_XOUT_H + i);
+		self->_missed_samples++;
 	}
+}
+
+void Mpu9250::burst_complete_isr(void)
+{
+	// The task never took the previous sample
+	if (_burst_ready >= 0)
+	{
+		_missed_samples++;
+	}
+
+	_burst_ready = _burst_write;
+	_burst_write ^= 1;
 
-	// reorder the LSB and MSB in the sensor data
-	SensorDataPacked temporaray = _sensor_data;
-
-	uint8_t* copy = static_cast<uint8_t*>((void*)&temporaray);
-	uint8_t* data = static_cast<uint8_t*>((void*)&_sensor_data);
-
-	// accel xyz
-	data[0] = copy[1];
-	data[1] = copy[0];
-	data[2] = copy[3];
-	data[3] = copy[2];
-	data[4] = copy[5];
-	data[5] = copy[4];
-	// temperature
-	data[6] = copy[7];
-	data[7] = copy[6];
-	// gyro xyz
-	data[8] = copy[9];
-	data[9] = copy[8];
-	data[10] = copy[11];
-	data[11] = copy[10];
-	data[12] = copy[13];
-	data[13] = copy[12];
-	// Mag data is already correct
+	BaseType_t higher_priority_task_woken = pdFALSE;
+	vTaskNotifyGiveFromISR(_sampling_task, &higher_priority_task_woken);
+	portYIELD_FROM_ISR(higher_priority_task_woken);
 }
 
-void Mpu9250::publish_accel_data(abs_time_t& timestamp)
+void Mpu9250::initialize_fifo(void)
+{
+	// Gyro at 8kHz -- GYRO_CONFIG already leaves FCHOICE_B clear
+	write_register(address::CONFIG, value::CONFIG_DLPF_GYRO_3600Hz);
+	write_register(address::ACCEL_CONFIG_2, value::ACCEL_NO_DLPF_4kHz);
+
+	// The data-ready pulse would now come at 8kHz
+	write_register(address::INT_ENABLE, value::INT_DISABLE);
+
+	write_register(address::FIFO_EN, value::FIFO_EN_GYRO);
+
+	reset_fifo();
+}
+
+void Mpu9250::reset_fifo(void)
+{
+	auto reg = read_register(address::USER_CTRL);
+	write_register(address::USER_CTRL, reg | value::BIT_FIFO_EN | value::BIT_FIFO_RST);
+
+	_fifo_next_timestamp = 0;
+}
+
+size_t Mpu9250::drain_fifo(abs_time_t& timestamp)
+{
+	timestamp = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+
+	update_calibration();
+
+	// The latest sample keeps the 1kHz topics going
+	read_registers(address::ACCEL_XOUT_H, _fifo_status, FIFO_STATUS_BYTES);
+	decode_sample(_fifo_status);
+
+	size_t level = (_fifo_status[FIFO_STATUS_BYTES - 2] << 8) | _fifo_status[FIFO_STATUS_BYTES - 1];
+
+	// A full FIFO has dropped frames and lost its alignment
+	if (level > FIFO_SIZE - FIFO_FRAME_BYTES)
+	{
+		reset_fifo();
+		_fifo_resets++;
+		return 0;
+	}
+
+	// Whole frames only, a frame being written stays for the next drain
+	size_t available = level / FIFO_FRAME_BYTES;
+	size_t frames = std::min(available, MAX_GYRO_BATCH);
+
+	if (frames == 0)
+	{
+		return 0;
+	}
+
+	read_registers(address::FIFO_R_W, _fifo_raw, frames * FIFO_FRAME_BYTES);
+
+	// The newest frame in the FIFO is from about when the level was read
+	abs_time_t first = timestamp - (available - 1) * FIFO_SAMPLE_INTERVAL_US;
+
+	if (_fifo_next_timestamp != 0)
+	{
+		// The level is only known to within a frame, so follow the ODR and correct slowly
+		int64_t error = static_cast<int64_t>(first - _fifo_next_timestamp);
+
+		if (error > -FIFO_RESYNC_US && error < FIFO_RESYNC_US)
+		{
+			first = _fifo_next_timestamp + error / 16;
+		}
+	}
+
+	_fifo_next_timestamp = first + frames * FIFO_SAMPLE_INTERVAL_US;
+
+	for (size_t i = 0; i < frames; i++)
+	{
+		const uint8_t* frame = &_fifo_raw[i * FIFO_FRAME_BYTES];
+
+		float x = mpu9250_decode::be16(frame) * RAD_S_PER_TICK;
+		float y = mpu9250_decode::be16(frame + 2) * RAD_S_PER_TICK;
+		float z = mpu9250_decode::be16(frame + 4) * RAD_S_PER_TICK;
+
+		_gyro_calibration.apply(x, y, z);
+
+		_gyro_batch.x[i] = x;
+		_gyro_batch.y[i] = y;
+		_gyro_batch.z[i] = z;
+	}
+
+	_gyro_batch.timestamp = first;
+	_gyro_batch.sample_interval = FIFO_SAMPLE_INTERVAL_US;
+	_gyro_batch.count = frames;
+	_gyro_batch_ready = true;
+
+	return frames;
+}
+
+void Mpu9250::publish_gyro_batch(void)
+{
+	if (_gyro_batch_ready)
+	{
+		_gyro_batch_pub.publish(_gyro_batch);
+		_gyro_batch_ready = false;
+	}
+}
+
+void Mpu9250::decode_sample(const uint8_t* raw)
 {
-	// Convert the raw data
-	float x = _sensor_data.accel_x * ACCEL_M_S2_PER_TICK;
-	float y = _sensor_data.accel_y * ACCEL_M_S2_PER_TICK;
-	float z = _sensor_data.accel_z * ACCEL_M_S2_PER_TICK;
-	float temp = _sensor_data.temperature / 333.87f + 21.0f;
+	mpu9250_decode::decode_burst(raw, _mag_factory_scale_factor_x, _mag_factory_scale_factor_y,
+		_mag_factory_scale_factor_z, _sample);
 
-	apply_accel_calibration(x,y,z);
+	_accel_calibration.apply(_sample.accel_x, _sample.accel_y, _sample.accel_z);
+	_gyro_calibration.apply(_sample.gyro_x, _sample.gyro_y, _sample.gyro_z);
+	_mag_calibration.apply(_sample.mag_x, _sample.mag_y, _sample.mag_z);
+}
+
+void Mpu9250::publish_accel_data(abs_time_t& timestamp)
+{
+	float x = _sample.accel_x;
+	float y = _sample.accel_y;
+	float z = _sample.accel_z;
+	float temp = _sample.temperature;
 
 	// Apply a lowpass filter
 	x = _accel_filter_x.apply(x);
@@ -329,13 +511,10 @@ void Mpu9250::publish_accel_data(abs_time_t& timestamp)
 
 void Mpu9250::publish_gyro_data(abs_time_t& timestamp)
 {
-	// Convert the raw data
-	float x = _sensor_data.gyro_x * RAD_S_PER_TICK;
-	float y = _sensor_data.gyro_y * RAD_S_PER_TICK;
-	float z = _sensor_data.gyro_z * RAD_S_PER_TICK;
-	float temp = _sensor_data.temperature  / 333.87f + 21.0f;
-
-	apply_gyro_calibration(x,y,z);
+	float x = _sample.gyro_x;
+	float y = _sample.gyro_y;
+	float z = _sample.gyro_z;
+	float temp = _sample.temperature;
 
 	// Stuff the message
 	gyro_raw_data_s data;
@@ -367,14 +546,10 @@ void Mpu9250::publish_gyro_data(abs_time_t& timestamp)
 
 void Mpu9250::publish_mag_data(abs_time_t& timestamp)
 {
-	// Convert the raw data
-	float x = _sensor_data.mag_x * _mag_factory_scale_factor_x;
-	float y = _sensor_data.mag_y * _mag_factory_scale_factor_y;
-	float z = _sensor_data.mag_z * _mag_factory_scale_factor_z;
-	float temp = _sensor_data.temperature  / 333.87f + 21.0f;
-
-	// TODO: fix shell calibration routine to first RESET the calibration scales to 1 and offsets to 0
-	apply_mag_calibration(x,y,z);
+	float x = _sample.mag_x;
+	float y = _sample.mag_y;
+	float z = _sample.mag_z;
+	float temp = _sample.temperature;
 
 	// Pass through a 50Hz LPF
 	x = _mag_filter_x.apply(x, timestamp);
@@ -398,21 +573,21 @@ void Mpu9250::publish_mag_data(abs_time_t& timestamp)
 
 void Mpu9250::print_formatted_data(void)
 {
-	float accel_x = _sensor_data.accel_x * ACCEL_M_S2_PER_TICK;
-	float accel_y = _sensor_data.accel_y * ACCEL_M_S2_PER_TICK;
-	float accel_z = _sensor_data.accel_z * ACCEL_M_S2_PER_TICK;
+	float accel_x = _sample.accel_x;
+	float accel_y = _sample.accel_y;
+	float accel_z = _sample.accel_z;
 
-	float gyro_x = _sensor_data.gyro_x * RAD_S_PER_TICK;
-	float gyro_y = _sensor_data.gyro_y * RAD_S_PER_TICK;
-	float gyro_z = _sensor_data.gyro_z * RAD_S_PER_TICK;
+	float gyro_x = _sample.gyro_x;
+	float gyro_y = _sample.gyro_y;
+	float gyro_z = _sample.gyro_z;
 
-	float temperature = _sensor_data.temperature / 333.87f + 21.0f;
+	float temperature = _sample.temperature;
 
-	float mag_st1 = _sensor_data.mag_st1;
-	float mag_x = _sensor_data.mag_x;
-	float mag_y = _sensor_data.mag_y;
-	float mag_z = _sensor_data.mag_z;
-	float mag_st2 = _sensor_data.mag_st2;
+	float mag_st1 = _sample.mag_st1;
+	float mag_x = _sample.mag_x;
+	float mag_y = _sample.mag_y;
+	float mag_z = _sample.mag_z;
+	float mag_st2 = _sample.mag_st2;
 
 	SYS_INFO("accel_x: %f", accel_x);
 	SYS_INFO("accel_y: %f", accel_y);
@@ -431,23 +606,14 @@ void Mpu9250::print_formatted_data(void)
 	SYS_INFO("--- --- --- --- --- --- ---");
 }
 
-void Mpu9250::apply_gyro_calibration(float& x, float& y, float& z)
+void Mpu9250::update_calibration(void)
 {
-	x = x - GYRO_OFFSET_X;
-	y = y - GYRO_OFFSET_Y;
-	z = z - GYRO_OFFSET_Z;
-}
+	if (_calibration_sub.updated())
+	{
+		auto msg = _calibration_sub.get();
 
-void Mpu9250::apply_accel_calibration(float& x, float& y, float& z)
-{
-	x = (x - ACCEL_OFFSET_X) * ACCEL_SCALE_X;
-	y = (y - ACCEL_OFFSET_Y) * ACCEL_SCALE_Y;
-	z = (z - ACCEL_OFFSET_Z) * ACCEL_SCALE_Z;
+		_gyro_calibration = calibration::from_message(msg, calibration::Sensor::GYRO);
+		_accel_calibration = calibration::from_message(msg, calibration::Sensor::ACCEL);
+		_mag_calibration = calibration::from_message(msg, calibration::Sensor::MAG);
+	}
 }
-
-void Mpu9250::apply_mag_calibration(float& x, float& y, float& z)
-{
-	x = (x - MAG_OFFSET_X) / MAG_SCALE_X;
-	y = (y - MAG_OFFSET_Y) / MAG_SCALE_Y;
-	z = (z - MAG_OFFSET_Z) / MAG_SCALE_Z;
-}
\ No newline at end of file
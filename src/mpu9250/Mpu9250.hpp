@@ -23,49 +23,31 @@
 #pragma once
 
 #include <mpu9250_registers.hpp>
+#include <mpu9250_decode.hpp>
 
 #include <Spi.hpp>
 #include <Messenger.hpp>
 #include <LowPassFilter.hpp>
 #include <ButterworthFilter.hpp>
+#include <SensorCalibration.hpp>
 
-//----- Calibration -----//
-// Gyro
-static constexpr float GYRO_OFFSET_X =  -0.011789f;
-static constexpr float GYRO_OFFSET_Y =  0.032313f;
-static constexpr float GYRO_OFFSET_Z =  0.027732f;
-// Accel
-static constexpr float ACCEL_OFFSET_X = 0.291080;
-static constexpr float ACCEL_OFFSET_Y = 0.200403;
-static constexpr float ACCEL_OFFSET_Z = -0.378607;
-static constexpr float ACCEL_SCALE_X = 1.001776;
-static constexpr float ACCEL_SCALE_Y = 1.001551;
-static constexpr float ACCEL_SCALE_Z = 0.985408;
-// Mag -- TODO: investigate why a single outlier fucks up the ellipsoid fit algorithm
-static constexpr float MAG_OFFSET_X =   10.0653f;
-static constexpr float MAG_OFFSET_Y =   34.8082f;
-static constexpr float MAG_OFFSET_Z =   -159.862;
-static constexpr float MAG_SCALE_X =  	289.209f;
-static constexpr float MAG_SCALE_Y =  	282.384f;
-static constexpr float MAG_SCALE_Z =  	262.062f;
-
-//----- Constants -----//
-// Gyro
-static constexpr double GYRO_FULL_SCALE_DPS = 2000.0;
-static constexpr double GYRO_FULL_SCALE_RAD_S = GYRO_FULL_SCALE_DPS / (180.0 / M_PI);
-static constexpr unsigned TICKS = 65536;
-static constexpr float RAD_S_PER_TICK = 2 * GYRO_FULL_SCALE_RAD_S / TICKS; // times 2 since +/- FS
-static constexpr float DEG_S_PER_TICK = RAD_S_PER_TICK * 180 / M_PI; // times 2 since +/- FS
-
-// Accel
-static constexpr double CONSTANTS_ONE_G = 9.80665; // m/s^2
-static constexpr double TICK_PER_G = 2048.0; // 65536 / 2
-static constexpr float ACCEL_M_S2_PER_TICK = CONSTANTS_ONE_G / TICK_PER_G;
+// make IMU_FIFO=1 -- gyro at 8kHz, drained from the FIFO in batches instead of the
+// data-ready interrupt
+#ifndef IMU_FIFO
+#define IMU_FIFO 0
+#endif
+
+// FIFO batch mode
+static constexpr abs_time_t FIFO_SAMPLE_INTERVAL_US = 125; // 8kHz gyro
+static constexpr size_t FIFO_SIZE = 512;
+static constexpr size_t FIFO_FRAME_BYTES = 6; // gyro xyz
+static constexpr size_t MAX_GYRO_BATCH = 16; // samples in a gyro_batch message
 
 namespace mpu9250_spi
 {
 
 static constexpr uint8_t CS = 10;
+static constexpr uint8_t DRDY = 9; // MPU9250 INT, pulses when a sample is ready
 static constexpr uint8_t BUS = 0;
 static constexpr unsigned FREQ = 8000000;
 
@@ -73,30 +55,14 @@ static constexpr unsigned FREQ = 8000000;
 
 class Mpu9250
 {
-	struct __attribute__((__packed__)) SensorDataPacked
-	{
-		int16_t		accel_x;
-		int16_t		accel_y;
-		int16_t		accel_z;
-		int16_t		temperature;
-		int16_t		gyro_x;
-		int16_t		gyro_y;
-		int16_t		gyro_z;
-		// Mag data is stored in the first slot for external sensors if enabled
-		uint8_t 	mag_st1;
-		int16_t 	mag_x;
-		int16_t 	mag_y;
-		int16_t 	mag_z;
-		uint8_t 	mag_st2;
-		int16_t		padding;
-	};
+	static constexpr size_t BURST_READ_BYTES = mpu9250_decode::BURST_READ_BYTES;
 
 public:
 
 	Mpu9250()
 	{
 		// Initialize the SPI interface
-		_interface = new interface::Spi(mpu9250_spi::BUS, mpu9250_spi::FREQ, mpu9250_spi::CS);
+		_interface = STATIC_NEW(interface::Spi, mpu9250_spi::BUS, mpu9250_spi::FREQ, mpu9250_spi::CS);
 	}
 
 	bool probe(void);
@@ -107,41 +73,45 @@ public:
 	bool new_data_available(void);
 	void collect_data(void);
 
+	// From here on the INT edge timestamps each sample and starts its burst read,
+	// task is notified once the sample is in. No polling.
+	void start_sampling(TaskHandle_t task);
+	// Decodes the newest sample, false if there is none yet
+	bool take_sample(abs_time_t& timestamp);
+	uint32_t missed_samples(void) const { return _missed_samples; };
+
+	// FIFO batch mode, after initialize_registers(): gyro at 8kHz, accel at 4kHz and no
+	// data-ready interrupt. drain_fifo() is then called about every ms.
+	void initialize_fifo(void);
+	// Reads the latest sample and up to MAX_GYRO_BATCH gyro frames, returns the frames read
+	size_t drain_fifo(abs_time_t& timestamp);
+	void publish_gyro_batch(void);
+	uint32_t fifo_resets(void) const { return _fifo_resets; };
+
 	void publish_accel_data(abs_time_t& timestamp);
 	void publish_gyro_data(abs_time_t& timestamp);
 	void publish_mag_data(abs_time_t& timestamp);
 
 	void print_formatted_data(void);
 
-	// calibration setters
-	void set_gyro_calibration(float offset, float scale)
-	{
-		_gyro_offset = offset;
-		_gyro_scale = scale;
-	}
-
-	void set_accel_calibration(float offset, float scale)
-	{
-		_accel_offset = offset;
-		_accel_scale = scale;
-	}
-
-	void set_mag_calibration(float offset, float scale)
-	{
-		_mag_offset = offset;
-		_mag_scale = scale;
-	}
-
 private:
-	void apply_gyro_calibration(float& x, float& y, float& z);
-	void apply_accel_calibration(float& x, float& y, float& z);
-	void apply_mag_calibration(float& x, float& y, float& z);
+	// Picks up parameters published on sensor_calibration
+	void update_calibration(void);
 
 	void initialize_magnetometer_registers(void);
 
 	// Read / Write for the MPU9250
 	void write_register(uint8_t addr, uint8_t val);
 	uint8_t read_register(uint8_t reg);
+	void read_registers(uint8_t reg, uint8_t* buf, size_t count); // one transaction
+
+	// Raw register image -> _sample, calibrated
+	void decode_sample(const uint8_t* raw);
+
+	static void data_ready_isr(void);
+	void burst_complete_isr(void);
+
+	void reset_fifo(void);
 
 	// Read / Write for the AK8963
 	void write_register_mag(uint8_t addr, uint8_t val);
@@ -152,12 +122,46 @@ private:
 
 	interface::Spi* _interface;
 
-	Mpu9250::SensorDataPacked _sensor_data;
+	alignas(4) uint8_t _raw[BURST_READ_BYTES] = {};
+	mpu9250_decode::Sample _sample = {};
+
+	// Interrupt driven sampling, double buffered so the task decodes one burst while
+	// the DMA fills the other. The byte clocked in with the address lands at the
+	// offset, so the sample itself starts word aligned.
+	static constexpr size_t BURST_RX_OFFSET = 3;
+
+	// Rows padded to whole words so the second buffer's sample is aligned as well
+	static constexpr size_t BURST_ROW_BYTES = (BURST_RX_OFFSET + 1 + BURST_READ_BYTES + 3) & ~size_t(3);
+	static_assert(BURST_ROW_BYTES % 4 == 0, "burst rows must keep the samples word aligned");
+	static_assert((BURST_RX_OFFSET + 1) % 4 == 0, "the sample must start on a word");
+
+	static Mpu9250* _sampling_instance;
+	TaskHandle_t _sampling_task = nullptr;
+
+	uint8_t _burst_tx[1 + BURST_READ_BYTES] = {};
+	alignas(4) uint8_t _burst_rx[2][BURST_ROW_BYTES] = {};
+	abs_time_t _burst_timestamp[2] = {};
+	uint8_t _burst_write = 0; // the buffer the next burst goes to
+	volatile int8_t _burst_ready = -1; // the buffer holding a sample not yet taken
+	volatile int8_t _burst_reading = -1; // the buffer the task is decoding, off limits to the DMA
+	volatile uint32_t _missed_samples = 0;
+
+	// FIFO batch mode. ACCEL_XOUT_H .. FIFO_COUNTL is the latest sample plus the FIFO
+	// level in one burst.
+	static constexpr size_t FIFO_STATUS_BYTES = address::FIFO_COUNTL - address::ACCEL_XOUT_H + 1;
+
+	alignas(4) uint8_t _fifo_status[FIFO_STATUS_BYTES] = {};
+	uint8_t _fifo_raw[MAX_GYRO_BATCH * FIFO_FRAME_BYTES] = {};
+	gyro_batch_s _gyro_batch = {}; // filled by drain_fifo()
+	bool _gyro_batch_ready = false;
+	abs_time_t _fifo_next_timestamp = 0; // expected time of the next frame, 0 after a reset
+	uint32_t _fifo_resets = 0;
 
 	messenger::Publisher<accel_raw_data_s> _accel_pub;
 	messenger::Publisher<gyro_raw_data_s> _gyro_pub;
 	messenger::Publisher<mag_raw_data_s> _mag_pub;
 	messenger::Publisher<gyro_filtered_data_s> _filtered_gyro_pub;
+	messenger::Publisher<gyro_batch_s> _gyro_batch_pub;
 
 
 	// mag factory cal "sensitivity adjustment"
@@ -165,15 +169,12 @@ private:
 	float _mag_factory_scale_factor_y = 0;
 	float _mag_factory_scale_factor_z = 0;
 
-	// User calibration
-	float _gyro_offset = 0;
-	float _gyro_scale= 0;
-
-	float _accel_offset = 0;
-	float _accel_scale = 0;
+	// User calibration, from the calibration store
+	calibration::SensorCalibration _gyro_calibration = calibration::SensorCalibration::identity();
+	calibration::SensorCalibration _accel_calibration = calibration::SensorCalibration::identity();
+	calibration::SensorCalibration _mag_calibration = calibration::SensorCalibration::identity();
 
-	float _mag_offset = 0;
-	float _mag_scale = 0;
+	messenger::Subscriber<sensor_calibration_s> _calibration_sub;
 
 	abs_time_t _last_timestamp = 0;
 
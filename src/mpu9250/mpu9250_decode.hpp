@@ -0,0 +1,125 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+//----- Constants -----//
+// Gyro
+static constexpr double GYRO_FULL_SCALE_DPS = 2000.0;
+static constexpr double GYRO_FULL_SCALE_RAD_S = GYRO_FULL_SCALE_DPS / (180.0 / M_PI);
+static constexpr unsigned TICKS = 65536;
+static constexpr float RAD_S_PER_TICK = 2 * GYRO_FULL_SCALE_RAD_S / TICKS; // times 2 since +/- FS
+static constexpr float DEG_S_PER_TICK = RAD_S_PER_TICK * 180 / M_PI; // times 2 since +/- FS
+
+// Accel
+static constexpr double CONSTANTS_ONE_G = 9.80665; // m/s^2
+static constexpr double TICK_PER_G = 2048.0; // 65536 / 2
+static constexpr float ACCEL_M_S2_PER_TICK = CONSTANTS_ONE_G / TICK_PER_G;
+
+// Turns the raw register image into units. Kept apart from the driver so that it builds
+// and is tested on the host -- the byte swaps fall back to plain shifts off target.
+namespace mpu9250_decode
+{
+
+// ACCEL_XOUT_H .. EXT_SENS_DATA_07 in one burst:
+// Accel (xyz)   temp(c)   Gyro(xyz) -- big endian
+// Mag (st1, xyz, st2) -- little endian, the AK8963 data copied into the ext sensor slot
+static constexpr size_t BURST_READ_BYTES = 22;
+
+// A sample decoded and calibrated, the filters are applied at publish
+struct Sample
+{
+	float accel_x; // m/s^2
+	float accel_y;
+	float accel_z;
+	float gyro_x; // rad/s
+	float gyro_y;
+	float gyro_z;
+	float mag_x; // factory and user calibrated
+	float mag_y;
+	float mag_z;
+	float temperature; // C
+	uint8_t mag_st1;
+	uint8_t mag_st2;
+};
+
+// Swaps the bytes in both halfwords -- a single REV16
+static inline uint32_t rev16(uint32_t word)
+{
+#if defined(__arm__)
+	uint32_t result;
+	asm ("rev16 %0, %1" : "=r" (result) : "r" (word));
+	return result;
+#else
+	return ((word & 0x00FF00FF) << 8) | ((word >> 8) & 0x00FF00FF);
+#endif
+}
+
+// A big endian register pair, a single REV16 once loaded
+static inline int16_t be16(const uint8_t* bytes)
+{
+	uint16_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return static_cast<int16_t>(__builtin_bswap16(value));
+}
+
+// BURST_READ_BYTES of raw registers -> sample, mag scaled by the factory adjustment
+static inline void decode_burst(const uint8_t* raw, float mag_scale_x, float mag_scale_y, float mag_scale_z,
+	Sample& sample)
+{
+	// The 7 big endian values, plus mag st1 and half of mag x in the last word
+	uint32_t words[4];
+	memcpy(words, raw, sizeof(words));
+
+	for (auto& word : words)
+	{
+		word = rev16(word);
+	}
+
+	auto low = [](uint32_t word) { return static_cast<int16_t>(word); };
+	auto high = [](uint32_t word) { return static_cast<int16_t>(word >> 16); };
+
+	sample.accel_x = low(words[0]) * ACCEL_M_S2_PER_TICK;
+	sample.accel_y = high(words[0]) * ACCEL_M_S2_PER_TICK;
+	sample.accel_z = low(words[1]) * ACCEL_M_S2_PER_TICK;
+	sample.temperature = high(words[1]) / 333.87f + 21.0f;
+	sample.gyro_x = low(words[2]) * RAD_S_PER_TICK;
+	sample.gyro_y = high(words[2]) * RAD_S_PER_TICK;
+	sample.gyro_z = low(words[3]) * RAD_S_PER_TICK;
+
+	// Mag data is already little endian
+	int16_t mag[3];
+	memcpy(mag, raw + 15, sizeof(mag));
+
+	sample.mag_st1 = raw[14];
+	sample.mag_x = mag[0] * mag_scale_x;
+	sample.mag_y = mag[1] * mag_scale_y;
+	sample.mag_z = mag[2] * mag_scale_z;
+	sample.mag_st2 = raw[21];
+}
+
+} // end namespace mpu9250_decode
@@ -34,6 +34,12 @@ static constexpr uint8_t GYRO_CONFIG = 27;
 static constexpr uint8_t ACCEL_CONFIG = 28;
 static constexpr uint8_t ACCEL_CONFIG_2 = 29;
 
+// FIFO
+static constexpr uint8_t FIFO_EN = 35; // which sensors are written to the FIFO
+static constexpr uint8_t FIFO_COUNTH = 114;
+static constexpr uint8_t FIFO_COUNTL = 115;
+static constexpr uint8_t FIFO_R_W = 116; // does not auto-increment, a burst reads the FIFO out
+
 // I2C master (magnetometer control)
 static constexpr uint8_t I2C_MSTR_CTRL = 36;
 static constexpr uint8_t I2C_SLV0_ADDR = 37; // R/W, i2c address
@@ -50,7 +56,7 @@ static constexpr uint8_t AK8963_ASAY = 0x11;
 static constexpr uint8_t AK8963_ASAZ = 0x12;
 
 // Interrupts
-static constexpr uint8_t INT_PIN_BYPASS_ENABLE_CONFIG = 55; // NOTE: unused -- defaults to "Interrupt status is cleared only by reading INT_STATUS register"
+static constexpr uint8_t INT_PIN_BYPASS_ENABLE_CONFIG = 55;
 static constexpr uint8_t INT_ENABLE = 56;
 
 // Measure
@@ -104,10 +110,18 @@ static constexpr uint8_t BIT_SIG_COND_RST = 0x01; // Reset all gyro digital sign
 static constexpr uint8_t I2C_MST_EN = 0x20; // Enable the I2C Master I/F module; pins ES_DA and ES_SCL are isolated from pins SDA/SDI and SCL/ SCLK.
 // Interrupt control
 static constexpr uint8_t INT_DISABLE = 0x00; // Disable I2C Slave module and put the serial interface in SPI mode only.
+static constexpr uint8_t RAW_RDY_EN = 0x01; // Raw sensor data ready interrupt to propagate to the INT pin
+// Interrupt pin -- active high, push-pull, 50us pulse
+static constexpr uint8_t INT_ANYRD_2CLEAR = 0x10; // Interrupt status is cleared by any read, the sample burst never reads INT_STATUS
 // Sample rate divider
 static constexpr uint8_t SMPLRT_DIV_NONE  = 0x00; // NOTE: This register is only effective when DLPF is being used.
 // Config
 static constexpr uint8_t CONFIG_DLPF_GYRO_92Hz = 0b000000010; // DLPF enabled: 1kHz sample rate    Bandwidth: 92Hz    Delay: 3.9ms
+static constexpr uint8_t CONFIG_DLPF_GYRO_3600Hz = 0b000000111; // 8kHz sample rate    Bandwidth: 3600Hz    Delay: 0.17ms -- FIFO_MODE clear, a full FIFO drops the oldest
+// FIFO
+static constexpr uint8_t FIFO_EN_GYRO = 0x70; // GYRO_XOUT, GYRO_YOUT, GYRO_ZOUT
+static constexpr uint8_t BIT_FIFO_EN = 0x40; // USER_CTRL
+static constexpr uint8_t BIT_FIFO_RST = 0x04; // USER_CTRL, self clearing
 // I2C master
 static constexpr uint8_t I2C_MST_RST = 0x02;
 static constexpr uint8_t BIT_I2C_MST_P_NSR = 0x10;
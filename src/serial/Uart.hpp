@@ -23,7 +23,6 @@
 #pragma once
 
 #include  <board_config.hpp>
-#include <functional>
 
 namespace interface
 {
@@ -43,7 +42,7 @@ public:
 	{
 		if (_instance == nullptr)
 		{
-			_instance = new T(uart, baud, format);
+			_instance = STATIC_NEW(T, uart, baud, format);
 		}
 
 		return _instance;
@@ -74,7 +73,7 @@ public:
 	template <typename T>
 	void register_interrupt_callback(T* obj)
 	{
-		_callback = std::bind(&T::interrupt_callback, obj);
+		_callback = [obj] { obj->interrupt_callback(); };
 		_callback_registered = true;
 	}
 
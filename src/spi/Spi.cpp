@@ -21,6 +21,7 @@
 // SOFTWARE.
 
 #include <Spi.hpp>
+#include <interrupt_lock.hpp>
 
 namespace interface
 {
@@ -43,44 +44,248 @@ Spi::Spi(uint8_t bus, unsigned freq, uint8_t cs)
 	pinMode(_chip_select, OUTPUT);
 }
 
-void Spi::transfer(uint8_t* send_buf, size_t ssize, uint8_t* recv_buf, size_t rsize)
+bool Spi::transfer_async(const uint8_t* send_buf, uint8_t* recv_buf, size_t size, fp_t&& on_complete)
 {
-	assert_chip_select();
+	if (size == 0 || size > SPI_MAX_TRANSFER_SIZE)
+	{
+		return false;
+	}
 
-	// Send all the bytes
-	for (size_t i = 0; i < ssize; i++)
+	if (!claim())
 	{
-		send_byte(send_buf[i]);
+		return false;
 	}
 
-	// Retrieve all the bytes
-	for (size_t i = 0; i < rsize; i++)
+	_on_complete = std::move(on_complete);
+	start(send_buf, recv_buf, size);
+
+	return true;
+}
+
+bool Spi::transfer(uint8_t* send_buf, size_t ssize, uint8_t* recv_buf, size_t rsize)
+{
+	size_t size = ssize + rsize;
+
+	if (size == 0 || size > SPI_MAX_TRANSFER_SIZE)
 	{
-		recv_buf[i] = receive_byte();
+		SYS_INFO("Spi transfer of %u bytes", static_cast<unsigned>(size));
+		return false;
 	}
 
-	deassert_chip_select();
+	bool scheduler_running = xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+
+	// Another device on the bus may be mid-transfer, and the staging buffers are
+	// its until it lets go
+	while (!claim())
+	{
+		if (scheduler_running)
+		{
+			vTaskDelay(1);
+		}
+	}
+
+	// The bytes to receive are clocked out as 0xFF
+	if (ssize > 0)
+	{
+		memcpy(_tx_buffer, send_buf, ssize);
+	}
+
+	memset(_tx_buffer + ssize, 0xFF, rsize);
+
+	// Drop a completion left behind by an earlier transfer that timed out
+	xSemaphoreTake(_complete_semaphore, 0);
+
+	_complete = false;
+	_blocking = true;
+
+	start(_tx_buffer, _rx_buffer, size);
+
+	if (scheduler_running)
+	{
+		xSemaphoreTake(_complete_semaphore, pdMS_TO_TICKS(SPI_TRANSFER_TIMEOUT_MS));
+	}
+	else
+	{
+		// No tick yet, poll in microsecond steps
+		for (unsigned us = 0; !_complete && us < SPI_TRANSFER_TIMEOUT_MS * 1000; us++)
+		{
+			delayMicroseconds(1);
+		}
+	}
+
+	bool complete;
+
+	{
+		// The ISR may land between the timeout and here, it either finished or it never will
+		InterruptLock lock;
+
+		complete = _complete;
+
+		if (!complete)
+		{
+			abort();
+		}
+
+		_blocking = false;
+	}
+
+	if (!complete)
+	{
+		SYS_INFO("Spi transfer of %u bytes timed out", static_cast<unsigned>(size));
+	}
+	else if (rsize > 0)
+	{
+		memcpy(recv_buf, _rx_buffer + ssize, rsize);
+	}
+
+	release();
+
+	return complete;
 }
 
-// NOTE: caller is responsible for asserting CS
-void Spi::send_byte(uint8_t byte)
+bool Spi::claim(void)
 {
-	spi4teensy3::send(byte);
+	// Also called from ISRs, e.g. a data-ready pin interrupt
+	auto saved_state = taskENTER_CRITICAL_FROM_ISR();
+
+	if (_busy)
+	{
+		taskEXIT_CRITICAL_FROM_ISR(saved_state);
+		return false;
+	}
+
+	_busy = true;
+	_active = this;
+
+	taskEXIT_CRITICAL_FROM_ISR(saved_state);
+
+	return true;
+}
+
+void Spi::start(const uint8_t* send_buf, uint8_t* recv_buf, size_t size)
+{
+	// Empty FIFOs, 8 bit frames (CTAR0) from the byte writes to PUSHR
+	SPI0_MCR = SPI_MCR_MSTR | SPI_MCR_CLR_RXF | SPI_MCR_CLR_TXF | SPI_MCR_PCSIS(0x1F);
+	SPI0_SR = 0xFF0F0000; // clear every flag
+
+	_dma_tx.sourceBuffer(send_buf, size);
+
+	if (recv_buf != nullptr)
+	{
+		_dma_rx.destinationBuffer(recv_buf, size);
+	}
+	else
+	{
+		_dma_rx.destination(_rx_discard);
+		_dma_rx.transferCount(size);
+	}
+
+	_dma_rx.enable();
+	_dma_tx.enable();
+
+	assert_chip_select();
+
+	// Let the FIFOs request the DMA, the transfer starts here
+	SPI0_RSER = SPI_RSER_RFDF_RE | SPI_RSER_RFDF_DIRS | SPI_RSER_TFFF_RE | SPI_RSER_TFFF_DIRS;
+}
+
+void Spi::dma_rx_isr(void)
+{
+	_dma_rx.clearInterrupt();
+
+	SPI0_RSER = 0;
+	SPI0_SR = 0xFF0F0000;
+
+	_active->deassert_chip_select();
+
+	if (_blocking)
+	{
+		// The waiting task still has to copy the RX bytes out, it releases the bus
+		_complete = true;
+
+		BaseType_t higher_priority_task_woken = pdFALSE;
+		xSemaphoreGiveFromISR(_complete_semaphore, &higher_priority_task_woken);
+		portYIELD_FROM_ISR(higher_priority_task_woken);
+		return;
+	}
+
+	// Free the bus before the callback so it can start the next transfer
+	fp_t on_complete = std::move(_on_complete);
+	release();
+
+	if (on_complete)
+	{
+		on_complete();
+	}
+}
+
+void Spi::abort(void)
+{
+	_dma_rx.disable();
+	_dma_tx.disable();
+	_dma_rx.clearInterrupt();
+
+	SPI0_RSER = 0;
+	SPI0_MCR = SPI_MCR_MSTR | SPI_MCR_CLR_RXF | SPI_MCR_CLR_TXF | SPI_MCR_PCSIS(0x1F);
+	SPI0_SR = 0xFF0F0000;
+
+	_active->deassert_chip_select();
 }
 
-// NOTE: caller is responsible for asserting CS
-uint8_t Spi::receive_byte(void)
+void Spi::release(void)
 {
-	return spi4teensy3::receive();
+	_active = nullptr;
+	_busy = false;
 }
 
 // ----- Static members----- //
 void Spi::spi_bus_init(uint8_t bus, unsigned frequency)
 {
 	spi4teensy3::init(bus, frequency);
+
+	// TX: one byte into PUSHR per TX FIFO fill request
+	_dma_tx.begin();
+	_dma_tx.destination((volatile uint8_t&)SPI0_PUSHR);
+	_dma_tx.disableOnCompletion();
+	_dma_tx.triggerAtHardwareEvent(DMAMUX_SOURCE_SPI0_TX);
+
+	// RX: one byte out of POPR per RX FIFO drain request, completion ends the transfer
+	_dma_rx.begin();
+	_dma_rx.source((volatile uint8_t&)SPI0_POPR);
+	_dma_rx.disableOnCompletion();
+	_dma_rx.interruptAtCompletion();
+	_dma_rx.triggerAtHardwareEvent(DMAMUX_SOURCE_SPI0_RX);
+	_dma_rx.attachInterrupt(dma_rx_isr);
+
+	// Created here as the first device may come up before the scheduler starts
+#if configSUPPORT_STATIC_ALLOCATION
+	_complete_semaphore = xSemaphoreCreateBinaryStatic(&_complete_semaphore_buffer);
+#else
+	_complete_semaphore = xSemaphoreCreateBinary();
+#endif
+
+	// Must be at or below configMAX_SYSCALL_INTERRUPT_PRIORITY for the FromISR calls
+	NVIC_SET_PRIORITY(IRQ_DMA_CH0 + _dma_rx.channel, 128);
 }
 
 uint8_t Spi::_spi_bus_init_mask = 0x00; // default no SPI busses initialized
 
+DMAChannel Spi::_dma_tx(false); // channels are allocated in spi_bus_init()
+DMAChannel Spi::_dma_rx(false);
+
+Spi* volatile Spi::_active = nullptr;
+volatile bool Spi::_busy = false;
+fp_t Spi::_on_complete;
+
+volatile bool Spi::_blocking = false;
+volatile bool Spi::_complete = false;
+SemaphoreHandle_t Spi::_complete_semaphore = nullptr;
+#if configSUPPORT_STATIC_ALLOCATION
+StaticSemaphore_t Spi::_complete_semaphore_buffer;
+#endif
+
+uint8_t Spi::_tx_buffer[SPI_MAX_TRANSFER_SIZE] = {};
+uint8_t Spi::_rx_buffer[SPI_MAX_TRANSFER_SIZE] = {};
+volatile uint8_t Spi::_rx_discard = 0;
 
-} // end namespace interface
\ No newline at end of file
+} // end namespace interface
@@ -22,37 +22,89 @@
 
 #pragma once
 
-#include <core_pins.h>
-#include <spi4teensy3.hpp>
+#include <board_config.hpp>
+#include <semphr.h>
+#include <DMAChannel.h>
 
 namespace interface
 {
 
+// Largest transfer in bytes on the wire -- a full MPU9250 FIFO batch fits
+static constexpr size_t SPI_MAX_TRANSFER_SIZE = 128;
+
+// How long a blocking transfer waits for the DMA before giving up on it
+static constexpr unsigned SPI_TRANSFER_TIMEOUT_MS = 10;
+
 class Spi
 {
 public:
 
 	Spi(uint8_t bus, unsigned frequency, uint8_t chip_select);
 
-	void transfer(uint8_t* send_buf, size_t ssize, uint8_t* recv_buf, size_t rsize);
+	// Full duplex, clocks size bytes out of send_buf while filling recv_buf (nullptr to
+	// discard what comes back). Returns straight away, false if the bus is busy or the
+	// transfer is too big. Safe from tasks and ISRs. Both buffers must stay valid until on_complete, which runs in
+	// the DMA interrupt once CS is released -- dispatch_from_isr() or notify from it.
+	bool transfer_async(const uint8_t* send_buf, uint8_t* recv_buf, size_t size, fp_t&& on_complete);
+
+	// Sends ssize bytes then receives rsize bytes. Blocks the calling task, not the
+	// core, until the DMA transfer is done. Returns false if it did not complete within
+	// SPI_TRANSFER_TIMEOUT_MS, recv_buf is left untouched then.
+	bool transfer(uint8_t* send_buf, size_t ssize, uint8_t* recv_buf, size_t rsize);
+
+	bool busy(void) const { return _busy; };
 
 	void assert_chip_select(void) { digitalWrite(_chip_select, LOW); };
 	void deassert_chip_select(void){ digitalWrite(_chip_select, HIGH); };
 
 private:
 	// ----- Instance ----- //
-	void send_byte(uint8_t byte);
-	uint8_t receive_byte(void);
-
 	uint8_t _chip_select = 0;
 
+	// Takes the bus for this device, false if a transfer is in flight
+	bool claim(void);
+
+	// Programs the DMA and starts clocking, the bus must be claimed
+	void start(const uint8_t* send_buf, uint8_t* recv_buf, size_t size);
+
 	// ----- Static ----- //
 	// TODO: implement support for more than SPI_0. Right now the spi4teensy3 lib just
 	// initializes SPI_0
 	// Configures registers to correctly initialize SPI_0
 	static void spi_bus_init(uint8_t bus, unsigned frequency);
 
+	// RX completion, the last byte has been clocked in
+	static void dma_rx_isr(void);
+
+	// Stops a transfer that never completed, call with interrupts masked
+	static void abort(void);
+
+	static void release(void);
+
 	static uint8_t _spi_bus_init_mask;
+
+	// One transfer at a time on the bus
+	static DMAChannel _dma_tx;
+	static DMAChannel _dma_rx;
+
+	static Spi* volatile _active;
+	static volatile bool _busy;
+	static fp_t _on_complete;
+
+	// A blocking transfer keeps the bus past the ISR until it has copied the RX bytes
+	// out, and is woken through its own semaphore rather than the task notification
+	static volatile bool _blocking;
+	static volatile bool _complete;
+	static SemaphoreHandle_t _complete_semaphore;
+#if configSUPPORT_STATIC_ALLOCATION
+	static StaticSemaphore_t _complete_semaphore_buffer;
+#endif
+
+	// Staging for the blocking transfer (only touched by the bus owner), and the
+	// sink for discarded RX bytes
+	static uint8_t _tx_buffer[SPI_MAX_TRANSFER_SIZE];
+	static uint8_t _rx_buffer[SPI_MAX_TRANSFER_SIZE];
+	static volatile uint8_t _rx_discard;
 };
 
 } // end namespace interface
@@ -28,10 +28,13 @@
 
 void controller_task(void* args)
 {
-	auto attitude_controller = new AttitudeControl();
+	auto attitude_controller = STATIC_NEW(AttitudeControl);
 
 	for(;;)
 	{
+		// Run as soon as the IMU publishes -- the timeout keeps the arm / kill logic alive without it
+		attitude_controller->wait_for_attitude_rate_data(2);
+
 		// Get controller command if updated
 		attitude_controller->get_rc_input();
 		attitude_controller->convert_sticks_to_setpoints();
@@ -51,8 +54,5 @@ void controller_task(void* args)
 		{
 			attitude_controller->outputs_motors_disarmed();
 		}
-
-		// 1kHz loop rate
-		vTaskDelay(1);
 	}
 }
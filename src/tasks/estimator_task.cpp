@@ -35,7 +35,7 @@ void estimator_task(void* args)
 	messenger::Publisher<attitude_euler_s> attitude_pub;
 
 
-	auto estimator = new ComplimentaryFilter(0.1);
+	auto estimator = STATIC_NEW(ComplimentaryFilter, 0.1);
 
 	for(;;)
 	{
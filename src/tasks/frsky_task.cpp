@@ -27,7 +27,7 @@
 void frsky_task(void* args)
 {
 	auto handle = xTaskGetCurrentTaskHandle();
-	auto sbus = new interface::Sbus(handle);
+	auto sbus = STATIC_NEW(interface::Sbus, handle);
 
 	for(;;)
 	{
@@ -24,10 +24,14 @@
 #include <Messenger.hpp>
 #include <DispatchQueue.hpp>
 #include <Mpu9250.hpp>
+#include <CalibrationStore.hpp>
 
 void imu_task(void* args)
 {
-	auto mpu9250 = new Mpu9250();
+	auto mpu9250 = STATIC_NEW(Mpu9250);
+
+	// Stored parameters, or the defaults -- the driver picks them up from the topic
+	calibration::load();
 
 	// Check to ensure device is alive
 	bool alive = false;
@@ -57,29 +61,50 @@ void imu_task(void* args)
 		SYS_INFO("... not alive ...");
 	}
 
-	static unsigned early_counter = 0;
+#if IMU_FIFO
+	mpu9250->initialize_fifo();
+
+	TickType_t wake_time = xTaskGetTickCount();
+
+	for(;;)
+	{
+		// 1kHz, 8 gyro samples are waiting in the FIFO each time
+		vTaskDelayUntil(&wake_time, 1);
+
+		abs_time_t time;
+
+		if (mpu9250->drain_fifo(time) > 0)
+		{
+			mpu9250->publish_gyro_batch();
+		}
+
+		mpu9250->publish_accel_data(time);
+		mpu9250->publish_gyro_data(time);
+		mpu9250->publish_mag_data(time);
+	}
+#else
+	// Samples now arrive through the data-ready interrupt
+	mpu9250->start_sampling(xTaskGetCurrentTaskHandle());
 
 	for(;;)
 	{
-		// Only read sensor when there is new data available
-		if (mpu9250->new_data_available())
+		// Woken once the burst read kicked off by the INT edge is complete
+		if (ulTaskNotifyTake(pdTRUE, 100) == 0)
 		{
-			mpu9250->collect_data();
+			SYS_INFO("mpu9250 data-ready timed out");
+			continue;
+		}
 
-			abs_time_t time = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+		abs_time_t time;
 
+		if (mpu9250->take_sample(time))
+		{
 			mpu9250->publish_accel_data(time);
 			mpu9250->publish_gyro_data(time);
 			mpu9250->publish_mag_data(time);
 
 			// mpu9250->print_formatted_data();
 		}
-		else
-		{
-			early_counter++;
-			// SYS_INFO("mpu9250 data was not available: %u", early_counter);
-		}
-
-		vTaskDelay(1); // 1kHz, sometimes we miss some data buts that's OK... I think
 	}
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,74 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <board_config.hpp>
+#include <Messenger.hpp>
+#include <PoolAllocator.hpp>
+
+// Must match the array sizes in msg/memory_status.msg
+static constexpr size_t MAX_MONITORED_TASKS = 16;
+
+static_assert(sizeof(memory_status_s::stack_free) / sizeof(uint16_t) == MAX_MONITORED_TASKS, "update memory_status.msg");
+static_assert(sizeof(memory_status_s::pool_in_use) / sizeof(uint16_t) == memory::POOL_COUNT, "update memory_status.msg");
+
+// Samples heap, pool and stack usage once a second and publishes it as memory_status
+void memory_monitor_task(void* args)
+{
+	messenger::Publisher<memory_status_s> memory_pub;
+
+	// Too big for this task's stack
+	static TaskStatus_t tasks[MAX_MONITORED_TASKS];
+
+	for(;;)
+	{
+		memory_status_s status = {};
+		status.timestamp = time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+		status.free_heap = xPortGetFreeHeapSize();
+		status.min_free_heap = xPortGetMinimumEverFreeHeapSize();
+
+		for (size_t i = 0; i < memory::POOL_COUNT; i++)
+		{
+			memory::PoolStats pool;
+			memory::pool_stats(i, pool);
+
+			status.pool_in_use[i] = pool.in_use;
+			status.pool_high_water[i] = pool.high_water;
+			status.pool_failures += pool.failures;
+		}
+
+		status.heap_fallbacks = memory::large_allocations() + memory::exhausted_allocations();
+		status.malloc_failures = malloc_failures();
+
+		// Returns 0 if there are more tasks than MAX_MONITORED_TASKS
+		status.task_count = uxTaskGetSystemState(tasks, MAX_MONITORED_TASKS, nullptr);
+
+		for (size_t i = 0; i < status.task_count; i++)
+		{
+			status.task_number[i] = tasks[i].xTaskNumber;
+			status.stack_free[i] = tasks[i].usStackHighWaterMark;
+		}
+
+		memory_pub.publish(status);
+
+		vTaskDelay(1000);
+	}
+}
@@ -22,27 +22,44 @@
 
 #include <board_config.hpp>
 #include <Messenger.hpp>
+#include <DispatchQueue.hpp>
+#include <PoolAllocator.hpp>
 #include <GyroCalibration.hpp>
 #include <AccelCalibration.hpp>
 #include <HorizonCalibration.hpp>
+#include <CalibrationStore.hpp>
 
 
+// Nothing is allocated until the first command arrives -- never before the scheduler starts
 std::string buffer;
-std::string GYRO_CAL = "cal gyro";
-std::string ACCEL_CAL = "cal accel";
-std::string MAG_CAL = "cal mag";
-std::string HORIZON_CAL = "cal horizon";
+const char* GYRO_CAL = "cal gyro";
+const char* ACCEL_CAL = "cal accel";
+const char* MAG_CAL = "cal mag";
+const char* HORIZON_CAL = "cal horizon";
+const char* STREAM_BINARY = "stream bin "; // followed by the topic name, e.g. accel_raw_data
+
+// Binary stream frame: sync bytes, payload length, the payload from messages::serialize()
+// and an 8 bit sum of the payload. tools/python_scripts/stream_decode.py reads it back.
+static constexpr uint8_t STREAM_SYNC[] = { 0xA5, 0x5A };
+static constexpr uint32_t STREAM_BINARY_BAUD = 460800;
 
 void evaluate_user_command(void);
 void calibrate_gyro(void);
 void calibrate_accel(void);
 void calibrate_horizon(void);
+void print_calibration(void);
+void list_topics(void);
+void print_topic_stats(void);
+void print_dispatch_profile(void);
+void print_memory_status(void);
 
 // Functions to allow streaming of data in CSV format
 void stream_accel_data(void);
 void stream_mag_data(void);
 void stream_attitude_euler_data(void);
 void stream_filtered_gyro_data(void);
+void stream_memory_status(void);
+bool stream_topic_binary(const std::string& topic);
 
 // NOTE: used to send rate controller setpoints and rate actuals for controller tuning
 void stream_controller_tuning_attitude(void);
@@ -107,6 +124,60 @@ void evaluate_user_command(void)
 		calibrate_horizon();
 		return;
 	}
+	else if (buffer == "cal show")
+	{
+		print_calibration();
+		return;
+	}
+	else if (buffer == "cal save")
+	{
+		calibration::save();
+		SYS_INFO("Calibration saved");
+		return;
+	}
+	else if (buffer == "cal load")
+	{
+		calibration::load();
+		print_calibration();
+		return;
+	}
+	else if (buffer == "cal reset")
+	{
+		calibration::reset();
+		SYS_INFO("Calibration reset to defaults, cal save to keep");
+		return;
+	}
+	else if (buffer.compare(0, strlen(STREAM_BINARY), STREAM_BINARY) == 0)
+	{
+		auto topic = buffer.substr(strlen(STREAM_BINARY));
+
+		if (!stream_topic_binary(topic))
+		{
+			SYS_INFO("Unknown topic: %s", topic.c_str());
+		}
+
+		return;
+	}
+	else if (buffer == "topics")
+	{
+		list_topics();
+		return;
+	}
+	else if (buffer == "top")
+	{
+		print_topic_stats();
+		return;
+	}
+	else if (buffer == "dispatch")
+	{
+		print_dispatch_profile();
+		return;
+	}
+	else if (buffer == "mem")
+	{
+		print_memory_status();
+		return;
+	}
 	else if (buffer == "stream accel")
 	{
 		SYS_INFO("Streaming accel data");
@@ -125,6 +196,12 @@ void evaluate_user_command(void)
 		stream_filtered_gyro_data();
 		return;
 	}
+	else if (buffer == "stream mem")
+	{
+		SYS_INFO("Streaming memory status");
+		stream_memory_status();
+		return;
+	}
 	else if (buffer == "stream rates_tuning")
 	{
 		SYS_INFO("Streaming controller tuning data");
@@ -145,7 +222,15 @@ void calibrate_gyro(void)
 {
 	GyroCalibration gyro;
 
+	// Measure the raw offsets, then keep the matrix that was there
+	auto current = calibration::get(calibration::Sensor::GYRO);
+	calibration::set(calibration::Sensor::GYRO, calibration::SensorCalibration::identity());
+	vTaskDelay(10);
+
 	gyro.calibrate();
+
+	calibration::set(calibration::Sensor::GYRO, gyro.result(current));
+	SYS_INFO("Gyro calibration applied, cal save to keep");
 }
 
 // For this one we want to put the sensor on each side (6 sides) and measure the static reading.
@@ -156,6 +241,10 @@ void calibrate_accel(void)
 {
 	AccelCalibration accel;
 
+	// The offsets and scales are found from the raw readings
+	calibration::set(calibration::Sensor::ACCEL, calibration::SensorCalibration::identity());
+	vTaskDelay(10);
+
 	while (!accel.all_sides_complete())
 	{
 		auto side = accel.get_next_side_to_calibrate();
@@ -166,16 +255,9 @@ void calibrate_accel(void)
 	// The gravity vector has been measured on each side, we now want to find the offsets and scales.
 	accel.calculate_offsets_and_scales();
 
-	// TODO:
-	// estimation::Estimator::Instance()->update_gyro_offset() ... or something like that
-	// estimation::Estimator::Instance()->update_gyro_scale()
-	// estimation::Estimator::Instance()->update_accel_offset()
-	// estimation::Estimator::Instance()->update_accel_scale()
-
-	// estimation::Estimator::Instance()->update_mag_offset() ... we could get fancy and do elipsoid fitting.. only if neccessary
-	// estimation::Estimator::Instance()->update_mag_scale()
-
-	// estimation::Estimator::Instance()->reset() ... to reinitialize the estimator with the new offsets and scales
+	// A 6 side fit has no cross-axis terms, the matrix is diagonal again
+	calibration::set(calibration::Sensor::ACCEL, accel.result());
+	SYS_INFO("Accel calibration applied, cal save to keep");
 }
 
 void calibrate_horizon(void)
@@ -185,6 +267,333 @@ void calibrate_horizon(void)
 	horizon.calibrate();
 }
 
+void print_calibration(void)
+{
+	for (size_t i = 0; i < calibration::SENSOR_COUNT; i++)
+	{
+		auto sensor = static_cast<calibration::Sensor>(i);
+		auto cal = calibration::get(sensor);
+
+		SYS_INFO("%-5s bias   % 10.5f % 10.5f % 10.5f", calibration::sensor_name(sensor), cal.bias[0], cal.bias[1], cal.bias[2]);
+
+		for (size_t row = 0; row < 3; row++)
+		{
+			SYS_INFO("      matrix % 10.5f % 10.5f % 10.5f", cal.matrix[row][0], cal.matrix[row][1], cal.matrix[row][2]);
+		}
+	}
+}
+
+void list_topics(void)
+{
+	for (size_t i = 0; i < messenger::TOPIC_COUNT; i++)
+	{
+		auto& topic = messenger::TOPIC_TABLE[i];
+		SYS_INFO("%2u %-24s %3u bytes  %s %u", i, topic.name, topic.size,
+			topic.kind == messenger::TopicKind::LOAN ? "slots" : "depth", topic.depth);
+	}
+}
+
+// Rates and intervals are measured since the previous "top"
+void print_topic_stats(void)
+{
+	SYS_INFO("%-21s %5s %5s %5s %5s %5s", "topic", "Hz", "avg", "min", "max", "miss");
+
+	for (size_t i = 0; i < messenger::TOPIC_COUNT; i++)
+	{
+		// Snapshot and restart the window without racing the publisher
+		vTaskSuspendAll();
+		messenger::TopicStats stats = messenger::TOPIC_STATS[i];
+		messenger::TOPIC_STATS[i].reset_window();
+		xTaskResumeAll();
+
+		unsigned avg = stats.interval_count ? stats.interval_sum / stats.interval_count : 0;
+		unsigned rate = avg ? MICROS_PER_SEC / avg : 0;
+
+		SYS_INFO("%-21s %5u %5u %5lu %5lu %5lu", messenger::TOPIC_TABLE[i].name, rate, avg,
+				stats.interval_min, stats.interval_max, stats.missed);
+	}
+}
+
+static void print_histogram(const char* label, const uint32_t (&histogram)[LATENESS_BUCKETS])
+{
+	SYS_INFO("  %-5s %5lu %5lu %5lu %5lu %5lu %5lu %5lu %5lu", label,
+			histogram[0], histogram[1], histogram[2], histogram[3],
+			histogram[4], histogram[5], histogram[6], histogram[7]);
+}
+
+static unsigned average_us(const ExecutionStats& execution, uint32_t runs)
+{
+	return runs ? execution.total_cycles / runs / CYCLES_PER_MICRO : 0;
+}
+
+// Cumulative since boot, histogram buckets are in us
+void print_dispatch_profile(void)
+{
+	for (size_t q = 0; q < DispatchQueue::queue_count(); q++)
+	{
+		auto* queue = DispatchQueue::queue(q);
+
+		SYS_INFO("%s", queue->name());
+		SYS_INFO("  %-5s %5s %5s %5s %5s %5s %5s %5s %5s", "us", "<16", "<32", "<64", "<128",
+				"<256", "<512", "<1k", "more");
+
+		for (size_t slot = 0; slot < MAX_INTERVAL_ITEMS; slot++)
+		{
+			IntervalProfile profile;
+
+			// Copy without racing the worker
+			vTaskSuspendAll();
+			bool scheduled = queue->profile(slot, profile);
+			xTaskResumeAll();
+
+			if (!scheduled)
+			{
+				continue;
+			}
+
+			auto& stats = profile.stats;
+
+			SYS_INFO(" job %u %s %lu us: runs %lu miss %lu skip %lu", profile.slot,
+					profile.one_shot ? "once" : "every", (uint32_t)profile.interval,
+					stats.runs, stats.deadline_misses, stats.skipped);
+			SYS_INFO("  late max %lu us  exec avg %u max %lu us", (uint32_t)stats.max_lateness,
+					average_us(stats.execution, stats.runs), stats.execution.max_cycles / CYCLES_PER_MICRO);
+			print_histogram("late", stats.lateness_histogram);
+			print_histogram("exec", stats.execution.histogram);
+		}
+
+		vTaskSuspendAll();
+		IntervalStats once = queue->one_shot_stats();
+		xTaskResumeAll();
+
+		if (once.runs > 0)
+		{
+			SYS_INFO(" one-shot jobs: runs %lu", once.runs);
+			SYS_INFO("  late max %lu us  exec avg %u max %lu us", (uint32_t)once.max_lateness,
+					average_us(once.execution, once.runs), once.execution.max_cycles / CYCLES_PER_MICRO);
+			print_histogram("late", once.lateness_histogram);
+			print_histogram("exec", once.execution.histogram);
+		}
+
+		static const char* lane_names[DISPATCH_LANE_COUNT] = { "critical", "normal", "background" };
+
+		for (size_t lane = 0; lane < DISPATCH_LANE_COUNT; lane++)
+		{
+			vTaskSuspendAll();
+			LaneStats stats = queue->lane_stats(static_cast<DispatchPriority>(lane));
+			xTaskResumeAll();
+
+			if (stats.runs == 0 && stats.dropped == 0)
+			{
+				continue;
+			}
+
+			SYS_INFO(" lane %s: runs %lu aged %lu drop %lu", lane_names[lane], stats.runs,
+					stats.aged, stats.dropped);
+			SYS_INFO("  delay max %lu us  exec avg %u max %lu us", (uint32_t)stats.max_delay,
+					average_us(stats.execution, stats.runs), stats.execution.max_cycles / CYCLES_PER_MICRO);
+			print_histogram("delay", stats.delay_histogram);
+			print_histogram("exec", stats.execution.histogram);
+		}
+	}
+}
+
+// Latest sample from the memory monitor, task names are looked up live
+void print_memory_status(void)
+{
+	messenger::Subscriber<memory_status_s> memory_sub;
+	auto status = memory_sub.get();
+
+	static TaskStatus_t tasks[sizeof(status.stack_free) / sizeof(status.stack_free[0])];
+	size_t task_count = uxTaskGetSystemState(tasks, sizeof(tasks) / sizeof(tasks[0]), nullptr);
+
+	SYS_INFO("heap: %lu free, %lu min free", status.free_heap, status.min_free_heap);
+
+	for (size_t i = 0; i < memory::POOL_COUNT; i++)
+	{
+		memory::PoolStats pool;
+		memory::pool_stats(i, pool);
+
+		SYS_INFO("pool %3u: %2u/%2u used, %2u max, %lu failed", pool.block_size, status.pool_in_use[i],
+				pool.blocks, status.pool_high_water[i], pool.failures);
+	}
+
+	SYS_INFO("heap fallbacks: %lu", status.heap_fallbacks);
+	SYS_INFO("heap failures: %lu", status.malloc_failures);
+	SYS_INFO("%-20s %s", "task", "stack free (words)");
+
+	for (size_t i = 0; i < status.task_count; i++)
+	{
+		const char* name = "?";
+
+		for (size_t t = 0; t < task_count; t++)
+		{
+			if (tasks[t].xTaskNumber == status.task_number[i])
+			{
+				name = tasks[t].pcTaskName;
+				break;
+			}
+		}
+
+		SYS_INFO("%-20s %u", name, status.stack_free[i]);
+	}
+
+	auto& crash = last_crash();
+
+	if (crash.reason != CrashReason::NONE)
+	{
+		SYS_INFO("last crash: %s in %s after %lu ms", crash_reason_name(crash.reason),
+				crash.task_name, crash.uptime_ms);
+	}
+}
+
+void stream_memory_status(void)
+{
+	Serial4.begin(115200, SERIAL_8N1);
+
+	messenger::Subscriber<memory_status_s> memory_sub;
+
+	SYS_INFO("Enabling memory status stream over serial4");
+
+	for(;;)
+	{
+		if (memory_sub.updated())
+		{
+			auto data = memory_sub.get();
+
+			// Tightest stack in the system
+			unsigned stack_free = UINT16_MAX;
+			for (size_t i = 0; i < data.task_count; i++)
+			{
+				stack_free = std::min<unsigned>(stack_free, data.stack_free[i]);
+			}
+
+			Serial4.print(data.free_heap);
+			Serial4.print(',');
+			Serial4.print(data.min_free_heap);
+			Serial4.print(',');
+			Serial4.print(stack_free);
+			Serial4.print("\n");
+		}
+
+		// The monitor publishes at 1hz
+		vTaskDelay(100);
+
+		// Any user input cancels the spewing of data
+		if (Serial.available())
+		{
+			SYS_INFO("Disabling memory status stream");
+			return;
+		}
+	}
+}
+
+// Serializes the newest sample of a topic, whichever way the topic is published
+template <typename T, messenger::TopicKind = messenger::topic_traits<T>::kind>
+class TopicReader
+{
+public:
+	bool read(uint8_t* payload)
+	{
+		if (!_sub.updated())
+		{
+			return false;
+		}
+
+		messages::serialize(_sub.get(), payload);
+		return true;
+	}
+
+private:
+	messenger::Subscriber<T> _sub;
+};
+
+template <typename T>
+class TopicReader<T, messenger::TopicKind::LOAN>
+{
+public:
+	bool read(uint8_t* payload)
+	{
+		if (!_sub.updated())
+		{
+			return false;
+		}
+
+		// Serialize straight out of the loaned slot and give it back
+		auto loan = _sub.get();
+
+		if (!loan)
+		{
+			return false;
+		}
+
+		messages::serialize(*loan, payload);
+		return true;
+	}
+
+private:
+	messenger::LoanedSubscriber<T> _sub;
+};
+
+template <typename T>
+void stream_binary(void)
+{
+	constexpr size_t payload_size = messages::message_metadata<T>::serialized_size;
+	static_assert(payload_size <= UINT8_MAX, "the frame length is a single byte");
+
+	uint8_t frame[sizeof(STREAM_SYNC) + 1 + payload_size + 1];
+	memcpy(frame, STREAM_SYNC, sizeof(STREAM_SYNC));
+	frame[sizeof(STREAM_SYNC)] = payload_size;
+	uint8_t* payload = &frame[sizeof(STREAM_SYNC) + 1];
+
+	Serial4.begin(STREAM_BINARY_BAUD, SERIAL_8N1);
+
+	TopicReader<T> reader;
+
+	SYS_INFO("Enabling %s binary stream over serial4", messages::message_metadata<T>::name());
+
+	for(;;)
+	{
+		if (reader.read(payload))
+		{
+			uint8_t sum = 0;
+			for (size_t i = 0; i < payload_size; i++)
+			{
+				sum += payload[i];
+			}
+
+			frame[sizeof(frame) - 1] = sum;
+
+			Serial4.write(frame, sizeof(frame));
+		}
+
+		// 100hz at most
+		vTaskDelay(10);
+
+		// Any user input cancels the spewing of data
+		if (Serial.available())
+		{
+			SYS_INFO("Disabling %s binary stream", messages::message_metadata<T>::name());
+			return;
+		}
+	}
+}
+
+// Looks the topic up by its .msg name
+bool stream_topic_binary(const std::string& topic)
+{
+#define STREAM_BINARY_TOPIC(type, depth, kind)				\
+	if (topic == messages::message_metadata<type>::name())	\
+	{														\
+		stream_binary<type>();								\
+		return true;										\
+	}
+	MESSENGER_TOPICS(STREAM_BINARY_TOPIC)
+#undef STREAM_BINARY_TOPIC
+
+	return false;
+}
+
 void stream_mag_data(void)
 {
 	Serial4.begin(115200, SERIAL_8N1);
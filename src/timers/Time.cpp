@@ -33,7 +33,7 @@ void HighPrecisionTimer::Instantiate(void)
 {
 	if (_instance == nullptr)
 	{
-		_instance = new HighPrecisionTimer();
+		_instance = STATIC_NEW(HighPrecisionTimer);
 	}
 }
 
@@ -47,48 +47,295 @@ HighPrecisionTimer::~HighPrecisionTimer()
 	delete _instance;
 }
 
+uint32_t HighPrecisionTimer::read_counter(void)
+{
+	uint32_t ticks = FTM0_CNT;
+
+	// If the flag was still clear the counter had not wrapped when we read it. If it is
+	// set, read again so that the count is known to be from after the wrap.
+	if (FTM0_SC & FTM_SC_TOF)
+	{
+		ticks = FTM0_CNT + FTM0_MAX_TICKS;
+	}
+
+	return ticks;
+}
+
 abs_time_t HighPrecisionTimer::get_absolute_time_us(void)
 {
-	abs_time_t current_time;
-	uint16_t tick_val;
+	uint32_t generation;
+	abs_time_t base;
+	uint32_t ticks;
+
+	do
+	{
+		generation = _generation;
+		base = _base_us;
+		ticks = read_counter();
+	} while (generation != _generation);
+
+	return base + ((static_cast<uint64_t>(ticks) * TICKS_TO_US_MULT) >> TICKS_TO_US_SHIFT);
+}
+
+abs_time_t HighPrecisionTimer::get_absolute_time_ns(void)
+{
+	uint32_t generation;
+	abs_time_t base;
+	uint32_t ticks;
+
+	do
+	{
+		generation = _generation;
+		base = _base_ns;
+		ticks = read_counter();
+	} while (generation != _generation);
+
+	return base + ((static_cast<uint64_t>(ticks) * TICKS_TO_NS_MULT) >> TICKS_TO_NS_SHIFT);
+}
+
+abs_time_t HighPrecisionTimer::get_absolute_time_ticks(void)
+{
+	uint32_t generation;
+	abs_time_t base;
+	uint32_t ticks;
+
+	do
+	{
+		generation = _generation;
+		base = _base_ticks;
+		ticks = read_counter();
+	} while (generation != _generation);
+
+	return base + ticks;
+}
+
+TimerClientId HighPrecisionTimer::register_client(fp_t&& callback)
+{
+	for (size_t i = 0; i < MAX_TIMER_CLIENTS; i++)
+	{
+		TimerClient& client = _clients[i];
+
+		if (!client.registered)
+		{
+			client.callback = std::move(callback);
+			client.armed = false;
+			client.enabled = true;
+			client.registered = true;
+			return i;
+		}
+	}
+
+	SYS_INFO("No free timer client (max %u)", static_cast<unsigned>(MAX_TIMER_CLIENTS));
+	return INVALID_TIMER_CLIENT;
+}
+
+void HighPrecisionTimer::unregister_client(TimerClientId client)
+{
+	if (client >= MAX_TIMER_CLIENTS)
+	{
+		return;
+	}
+
+	clear_compare(client);
+	_clients[client].registered = false;
+	_clients[client].enabled = false;
+	_clients[client].callback = nullptr;
+}
+
+void HighPrecisionTimer::set_compare(TimerClientId client, abs_time_t deadline_us)
+{
+	if (client >= MAX_TIMER_CLIENTS || !_clients[client].registered)
+	{
+		return;
+	}
+
+	_clients[client].deadline_ticks = deadline_us * FTM0_TICKS_PER_MICRO;
+	_clients[client].armed = true;
+
+	if (!_servicing)
+	{
+		select_compare();
+	}
+}
+
+void HighPrecisionTimer::clear_compare(TimerClientId client)
+{
+	if (client >= MAX_TIMER_CLIENTS)
+	{
+		return;
+	}
+
+	_clients[client].armed = false;
+
+	if (!_servicing)
+	{
+		select_compare();
+	}
+}
+
+void HighPrecisionTimer::disable_callback(TimerClientId client)
+{
+	if (client < MAX_TIMER_CLIENTS)
+	{
+		_clients[client].enabled = false;
+	}
+}
+
+void HighPrecisionTimer::enable_callback(TimerClientId client)
+{
+	if (client < MAX_TIMER_CLIENTS)
+	{
+		_clients[client].enabled = true;
+	}
+}
 
-	// Not reentrant
-	taskENTER_CRITICAL();
+void HighPrecisionTimer::select_compare(void)
+{
+	bool found = false;
+	abs_time_t earliest = 0;
 
-	tick_val = FTM0_CNT;
+	for (size_t i = 0; i < MAX_TIMER_CLIENTS; i++)
+	{
+		const TimerClient& client = _clients[i];
 
-	current_time = FTM0_PICOS_PER_TICK * (_base_ticks + tick_val);
+		if (client.armed && (!found || client.deadline_ticks < earliest))
+		{
+			earliest = client.deadline_ticks;
+			found = true;
+		}
+	}
+
+	_compare_pending = false;
+
+	if (!found)
+	{
+		_compare_armed = false;
 
-	current_time /= PICOS_PER_MICRO;
+		// Disable the channel interrupt, this also clears a stale CHF
+		FTM0_C0SC = FTM_CSC_MSA;
+		return;
+	}
 
-	taskEXIT_CRITICAL();
+	_compare_ticks = earliest;
+	_compare_armed = true;
 
-	return current_time;
+	arm_compare();
 }
 
-abs_time_t HighPrecisionTimer::get_absolute_time_us_from_isr(void)
+void HighPrecisionTimer::arm_compare(void)
 {
-	abs_time_t current_time;
-	uint16_t tick_val;
+	if (!_compare_armed || _compare_pending)
+	{
+		return;
+	}
+
+	abs_time_t now = _base_ticks + read_counter();
+
+	// Too close to program reliably, fire from the ISR straight away
+	if (_compare_ticks <= now + MIN_COMPARE_TICKS)
+	{
+		_compare_pending = true;
+		NVIC_SET_PENDING(IRQ_FTM0);
+		return;
+	}
 
-	tick_val = FTM0_CNT;
+	abs_time_t target = _compare_ticks - _base_ticks;
 
-	current_time = FTM0_PICOS_PER_TICK * (_base_ticks + tick_val);
+	if (target >= FTM0_MAX_TICKS)
+	{
+		// Not in this period, the overflow ISR will come back to it
+		FTM0_C0SC = FTM_CSC_MSA;
+		return;
+	}
 
-	current_time /= PICOS_PER_MICRO;
+	FTM0_C0SC = FTM_CSC_MSA; // clear a stale CHF before enabling the interrupt
+	FTM0_C0V = static_cast<uint32_t>(target);
+	FTM0_C0SC = FTM_CSC_MSA | FTM_CSC_CHIE;
 
-	return current_time;
+	// The counter may have passed the target while it was being written
+	if (read_counter() >= target)
+	{
+		_compare_pending = true;
+		NVIC_SET_PENDING(IRQ_FTM0);
+	}
+}
+
+void HighPrecisionTimer::handle_timer_interrupt(void)
+{
+	// Overflow first so the compare is judged against the new base
+	if (FTM0_SC & FTM_SC_TOF)
+	{
+		handle_timer_overflow();
+	}
+
+	handle_compare();
 }
 
 void HighPrecisionTimer::handle_timer_overflow(void)
 {
+	// A higher priority ISR reading the time must never see half of this
+	__disable_irq();
+
 	_base_ticks += FTM0_MAX_TICKS;
+	_base_us += FTM0_MICROS_PER_OVERFLOW;
+	_base_ns += FTM0_MICROS_PER_OVERFLOW * 1000;
+
+	// Clear overflow flag
+	FTM0_SC &= ~FTM_SC_TOF;
+
+	_generation++;
+
+	__enable_irq();
+
 	_freertos_stats_base_ticks = _base_ticks;
 
-	if (_callback_registered && _callback_enabled)
+	// Program a compare that has come into this period
+	arm_compare();
+}
+
+void HighPrecisionTimer::handle_compare(void)
+{
+	uint32_t status = FTM0_C0SC;
+	bool matched = (status & FTM_CSC_CHF) && (status & FTM_CSC_CHIE);
+
+	if (!_compare_armed || !(_compare_pending || matched))
 	{
-		_callback();
+		return;
 	}
+
+	_compare_armed = false;
+	_compare_pending = false;
+
+	// CHF was read as set above, writing it as zero clears it
+	FTM0_C0SC = FTM_CSC_MSA;
+
+	// Only the clients that are due -- usually just the one that owns the compare. Any
+	// deadlines that landed together are served in this one interrupt.
+	abs_time_t due = _base_ticks + read_counter() + MIN_COMPARE_TICKS;
+
+	_servicing = true;
+
+	for (size_t i = 0; i < MAX_TIMER_CLIENTS; i++)
+	{
+		TimerClient& client = _clients[i];
+
+		if (!client.armed || client.deadline_ticks > due)
+		{
+			continue;
+		}
+
+		client.armed = false;
+
+		// May call set_compare() again for the client's next deadline
+		if (client.enabled)
+		{
+			client.callback();
+		}
+	}
+
+	_servicing = false;
+
+	select_compare();
 }
 
 } // end namespace time
@@ -102,12 +349,11 @@ extern "C" void ftm0_isr(void)
 
 	if (time::HighPrecisionTimer::Instance() != nullptr)
 	{
-		time::HighPrecisionTimer::Instance()->handle_timer_overflow();
+		time::HighPrecisionTimer::Instance()->handle_timer_interrupt();
 	}
-
-	// Clear overflow flag
-	if ((FTM0_SC & FTM_SC_TOF) != 0)
+	else if ((FTM0_SC & FTM_SC_TOF) != 0)
 	{
+		// Clear overflow flag, a wrap seen here would be lost from the time base
 		FTM0_SC &= ~FTM_SC_TOF;
 	}
 
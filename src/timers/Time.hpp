@@ -24,9 +24,24 @@
 
 #include <board_config.hpp>
 
-#define FTM0_MAX_TICKS 6000U // modulo value
+#define FTM0_MAX_TICKS 60000U // ticks per overflow, the modulo is one less
 
-static constexpr abs_time_t FTM0_PICOS_PER_TICK = 16667LLU;
+static constexpr uint32_t FTM0_TICKS_PER_MICRO = F_BUS / 1000000;
+static constexpr abs_time_t FTM0_MICROS_PER_OVERFLOW = FTM0_MAX_TICKS / FTM0_TICKS_PER_MICRO;
+
+static_assert(FTM0_MAX_TICKS % FTM0_TICKS_PER_MICRO == 0, "an overflow must be a whole number of us");
+static_assert(FTM0_MAX_TICKS <= 0x10000, "FTM0 is a 16 bit counter");
+
+// Ticks to time as (ticks * MULT) >> SHIFT instead of a division, a single UMULL. Exact
+// for every tick count below 2 * FTM0_MAX_TICKS, which is all a read ever converts.
+static constexpr uint32_t TICKS_TO_US_SHIFT = 32;
+static constexpr uint32_t TICKS_TO_US_MULT = (1ULL << TICKS_TO_US_SHIFT) / FTM0_TICKS_PER_MICRO + 1;
+static constexpr uint32_t TICKS_TO_NS_SHIFT = 26;
+static constexpr uint32_t TICKS_TO_NS_MULT = (1000ULL << TICKS_TO_NS_SHIFT) / FTM0_TICKS_PER_MICRO + 1;
+
+// A compare closer than this to the counter may be missed, so it is fired by pending
+// the ISR directly instead
+static constexpr uint32_t MIN_COMPARE_TICKS = FTM0_TICKS_PER_MICRO;
 
 extern volatile uint32_t _freertos_stats_base_ticks;
 
@@ -34,14 +49,21 @@ namespace time {
 
 static constexpr abs_time_t MAX_TIME = 0xFFFFFFFFFFFFFFFF;
 
+// One client per dispatch queue, each with its own deadline on the shared compare
+static constexpr size_t MAX_TIMER_CLIENTS = 4;
+
+using TimerClientId = uint8_t;
+static constexpr TimerClientId INVALID_TIMER_CLIENT = 0xFF;
+
 ///////////////////////////////
 //---- HIGH PRECISION / DISPATCH SCHEDULING ----//
 // Frequency: 60MHz (F_BUS)
 // counter: 16bit
 // prescaler: 1
-// modulo: 6,000 == FTM1_MAX_TICKS
+// modulo: 59,999 == FTM0_MAX_TICKS - 1
 // resolution: 16.6666ns
-// overflow rate: 0.1ms --> 10kHz
+// overflow rate: 1ms --> 1kHz, keeps the time base
+// channel 0: software output compare, armed for the earliest client deadline
 class HighPrecisionTimer
 {
 public:
@@ -51,35 +73,80 @@ public:
 	static void Instantiate(void);
 	static HighPrecisionTimer* Instance();
 
-	void handle_timer_overflow(void);
+	void handle_timer_interrupt(void);
 
+	// Lock-free, safe from tasks and from ISRs of any priority
 	abs_time_t get_absolute_time_us(void);
-	abs_time_t get_absolute_time_us_from_isr(void);
+	abs_time_t get_absolute_time_us_from_isr(void) { return get_absolute_time_us(); };
+	abs_time_t get_absolute_time_ns(void);
+	abs_time_t get_absolute_time_ticks(void); // F_BUS ticks, 16.67ns
 
+	// Returns INVALID_TIMER_CLIENT if all MAX_TIMER_CLIENTS are taken
 	template <typename T>
-	void register_overflow_callback(T* obj)
+	TimerClientId register_deadline_callback(T* obj)
 	{
-		_callback = std::bind(&T::timer_overflow_callback, obj);
-		_callback_registered = true;
-		enable_callback();
+		return register_client([obj] { obj->timer_deadline_callback(); });
 	}
+	void unregister_client(TimerClientId client);
+
+	// Fire the client's callback once, at or just after deadline_us. Replaces the
+	// client's previous deadline, other clients are unaffected. Call with FTM0 masked --
+	// in a critical section or from a deadline callback.
+	void set_compare(TimerClientId client, abs_time_t deadline_us);
+	void clear_compare(TimerClientId client);
 
-	void disable_callback(void) { _callback_enabled = false; };
-	void enable_callback(void) { _callback_enabled = true; };
+	// A deadline that passes while the callback is disabled is dropped
+	void disable_callback(TimerClientId client);
+	void enable_callback(TimerClientId client);
 
 private:
+	friend class StaticObject<HighPrecisionTimer>; // Instantiate() with STATIC_ALLOCATION
+
 	HighPrecisionTimer(){}; // Private so that it can not be called
 	HighPrecisionTimer(HighPrecisionTimer const&) {}; // copy constructor is private
 	HighPrecisionTimer& operator=(HighPrecisionTimer const&){ return *Instance(); }; // assignment operator is private
 
 	static HighPrecisionTimer* _instance;
 
-	abs_time_t _base_ticks = 0;
+	// Counter ticks since the last overflow. Adds a whole period if the counter has
+	// wrapped but the overflow ISR has not run yet.
+	static uint32_t read_counter(void);
+
+	TimerClientId register_client(fp_t&& callback);
+
+	void handle_timer_overflow(void);
+	void handle_compare(void);
 
-	volatile bool _callback_registered = false;
-	volatile bool _callback_enabled = false;
+	// Point the compare at the earliest armed client deadline
+	void select_compare(void);
 
-	fp_t _callback; // A function pointer to a callback function that gets called after an overflow event.
+	// Program channel 0 if the compare falls in the current period, the overflow
+	// ISR calls it again for compares further out
+	void arm_compare(void);
+
+	// Time at the last overflow, written by the ISR with interrupts disabled. Readers
+	// take a copy and retry if _generation changed meanwhile.
+	volatile abs_time_t _base_ticks = 0;
+	volatile abs_time_t _base_us = 0;
+	volatile abs_time_t _base_ns = 0;
+	volatile uint32_t _generation = 0;
+
+	struct TimerClient
+	{
+		fp_t callback;
+		abs_time_t deadline_ticks = 0;
+		bool registered = false;
+		bool enabled = false;
+		bool armed = false;
+	};
+
+	TimerClient _clients[MAX_TIMER_CLIENTS];
+
+	// The deadline channel 0 is working towards, the earliest of the armed clients
+	abs_time_t _compare_ticks = 0;
+	bool _compare_armed = false;
+	bool _compare_pending = false; // fire on the next ISR entry, the deadline is here
+	bool _servicing = false; // in handle_compare(), reselect once the callbacks return
 };
 
 } // end namespace time
@@ -0,0 +1,290 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests for the IMU calibration. SensorCalibration::apply() is checked against a plain
+// matrix * (raw - bias) for the identity, diagonal and full matrix cases, and the store
+// is taken through a save / load round trip on the host EEPROM, including the records
+// load() has to turn away: erased, corrupted, a foreign magic and an old version.
+
+#include <CalibrationStore.hpp>
+#include <timers/Time.hpp>
+
+using calibration::Sensor;
+using calibration::SensorCalibration;
+
+// The record layout in CalibrationStore.cpp: magic, version, size, the sensors, checksum
+static constexpr size_t RECORD_VERSION_OFFSET = 4;
+static constexpr size_t RECORD_SENSORS_OFFSET = 8;
+static constexpr size_t RECORD_SIZE = RECORD_SENSORS_OFFSET + calibration::SENSOR_COUNT * sizeof(SensorCalibration) + 4;
+
+static void reference_apply(const SensorCalibration& c, const float in[3], float out[3])
+{
+	for (size_t row = 0; row < 3; row++)
+	{
+		double sum = 0;
+
+		for (size_t col = 0; col < 3; col++)
+		{
+			sum += static_cast<double>(c.matrix[row][col]) * (in[col] - c.bias[col]);
+		}
+
+		out[row] = sum;
+	}
+}
+
+static bool same(const SensorCalibration& a, const SensorCalibration& b)
+{
+	return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static SensorCalibration random_calibration(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> bias(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> element(-2.0f, 2.0f);
+
+	SensorCalibration c;
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		c.bias[i] = bias(random);
+
+		for (size_t j = 0; j < 3; j++)
+		{
+			c.matrix[i][j] = element(random);
+		}
+	}
+
+	return c;
+}
+
+static void test_apply(void)
+{
+	float x = 1.5f, y = -2.25f, z = 9.8f;
+
+	SensorCalibration::identity().apply(x, y, z);
+	assert(x == 1.5f && y == -2.25f && z == 9.8f);
+
+	// Offsets and scales only, each axis on its own
+	SensorCalibration diagonal = SensorCalibration::diagonal(0.5f, -1.0f, 2.0f, 2.0f, 0.5f, -1.0f);
+	diagonal.apply(x, y, z);
+	assert(x == 2.0f && y == -0.625f && fabsf(z + 7.8f) < 1e-6f);
+
+	// A 90 degree turn about z swaps x and y
+	SensorCalibration rotation = { { 0, 0, 0 }, { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } } };
+	x = 1.0f, y = 2.0f, z = 3.0f;
+	rotation.apply(x, y, z);
+	assert(x == -2.0f && y == 1.0f && z == 3.0f);
+
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> reading(-500.0f, 500.0f);
+
+	for (size_t i = 0; i < 100000; i++)
+	{
+		SensorCalibration c = random_calibration(random);
+
+		float in[3] = { reading(random), reading(random), reading(random) };
+		float expected[3];
+		reference_apply(c, in, expected);
+
+		x = in[0], y = in[1], z = in[2];
+		c.apply(x, y, z);
+
+		float out[3] = { x, y, z };
+
+		// Terms reach a few thousand, so a few float ulps of those
+		for (size_t axis = 0; axis < 3; axis++)
+		{
+			assert(fabsf(out[axis] - expected[axis]) < 1e-2f);
+		}
+	}
+}
+
+static void test_round_trip(void)
+{
+	host::erase_eeprom();
+
+	// Nothing stored yet, the defaults stay
+	SensorCalibration gyro_default = calibration::get(Sensor::GYRO);
+	assert(!calibration::load());
+	assert(same(calibration::get(Sensor::GYRO), gyro_default));
+
+	std::mt19937 random(5);
+	SensorCalibration stored[calibration::SENSOR_COUNT];
+
+	for (size_t i = 0; i < calibration::SENSOR_COUNT; i++)
+	{
+		stored[i] = random_calibration(random);
+		calibration::set(static_cast<Sensor>(i), stored[i]);
+	}
+
+	calibration::save();
+
+	// Back to the defaults, then load what was saved
+	calibration::reset();
+	assert(same(calibration::get(Sensor::GYRO), gyro_default));
+
+	messenger::Subscriber<sensor_calibration_s> subscriber;
+	assert(calibration::load());
+
+	for (size_t i = 0; i < calibration::SENSOR_COUNT; i++)
+	{
+		assert(same(calibration::get(static_cast<Sensor>(i)), stored[i]));
+	}
+
+	// and what was loaded is published
+	assert(subscriber.updated());
+	sensor_calibration_s msg = subscriber.get();
+
+	for (size_t i = 0; i < calibration::SENSOR_COUNT; i++)
+	{
+		Sensor sensor = static_cast<Sensor>(i);
+		assert(same(calibration::from_message(msg, sensor), stored[i]));
+	}
+}
+
+// Damages one byte of a good record, load() must refuse it and keep what it had
+static void expect_rejected(size_t offset, uint8_t mask)
+{
+	calibration::save();
+
+	SensorCalibration before = calibration::get(Sensor::ACCEL);
+
+	// Load something else first, so a record that slipped through would show
+	calibration::reset();
+	SensorCalibration defaults = calibration::get(Sensor::ACCEL);
+	assert(!same(before, defaults));
+
+	host::eeprom()[offset] ^= mask;
+	assert(!calibration::load());
+	assert(same(calibration::get(Sensor::ACCEL), defaults));
+
+	// The undamaged record still loads
+	host::eeprom()[offset] ^= mask;
+	assert(calibration::load());
+	assert(same(calibration::get(Sensor::ACCEL), before));
+}
+
+static void test_rejected_records(void)
+{
+	std::mt19937 random(9);
+	calibration::set(Sensor::ACCEL, random_calibration(random));
+
+	expect_rejected(0, 0x01); // magic
+	expect_rejected(RECORD_VERSION_OFFSET, 0x01); // version
+	expect_rejected(RECORD_VERSION_OFFSET + 2, 0x04); // size
+	expect_rejected(RECORD_SENSORS_OFFSET + 17, 0x80); // a sensor parameter
+	expect_rejected(RECORD_SIZE - 5, 0x01); // the last byte of the last matrix
+	expect_rejected(RECORD_SIZE - 1, 0x40); // the checksum itself
+
+	assert(calibration::load());
+}
+
+//-------------------- Benchmark --------------------//
+
+// The per axis calibration the matrix replaced: an offset pass then a scale pass
+struct AxisCalibration
+{
+	float offset[3];
+	float scale[3];
+};
+
+static void benchmark(void)
+{
+	static constexpr size_t SAMPLES = 4096;
+	static constexpr size_t ROUNDS = 2000;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> reading(-500.0f, 500.0f);
+
+	static float xs[SAMPLES], ys[SAMPLES], zs[SAMPLES];
+
+	auto fill = [&]
+	{
+		for (size_t i = 0; i < SAMPLES; i++)
+		{
+			xs[i] = reading(random);
+			ys[i] = reading(random);
+			zs[i] = reading(random);
+		}
+	};
+
+	SensorCalibration matrix = random_calibration(random);
+	AxisCalibration axis = { { 1.0f, 2.0f, 3.0f }, { 0.9f, 1.1f, 1.05f } };
+
+	fill();
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t round = 0; round < ROUNDS; round++)
+	{
+		for (size_t i = 0; i < SAMPLES; i++)
+		{
+			xs[i] -= axis.offset[0];
+			ys[i] -= axis.offset[1];
+			zs[i] -= axis.offset[2];
+		}
+
+		for (size_t i = 0; i < SAMPLES; i++)
+		{
+			xs[i] *= axis.scale[0];
+			ys[i] *= axis.scale[1];
+			zs[i] *= axis.scale[2];
+		}
+
+		asm volatile("" : : "r"(xs), "r"(ys), "r"(zs) : "memory");
+	}
+
+	double axis_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	fill();
+	start = std::chrono::steady_clock::now();
+
+	for (size_t round = 0; round < ROUNDS; round++)
+	{
+		for (size_t i = 0; i < SAMPLES; i++)
+		{
+			matrix.apply(xs[i], ys[i], zs[i]);
+		}
+
+		asm volatile("" : : "r"(xs), "r"(ys), "r"(zs) : "memory");
+	}
+
+	double matrix_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	printf("calibrate one sample:\n");
+	printf("  per axis offset + scale passes: %6.2f ns/sample\n", axis_ns / (SAMPLES * ROUNDS));
+	printf("  fused bias + 3x3 matrix:        %6.2f ns/sample\n", matrix_ns / (SAMPLES * ROUNDS));
+}
+
+int main(void)
+{
+	// Stamps the published sensor_calibration
+	time::HighPrecisionTimer::Instantiate();
+
+	test_apply();
+	test_round_trip();
+	test_rejected_records();
+
+	benchmark();
+
+	printf("calibration_test: OK\n");
+	return 0;
+}
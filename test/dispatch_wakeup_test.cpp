@@ -0,0 +1,124 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests that adding interval and one-shot work from another task wakes a DispatchQueue
+// worker that is blocked waiting for work. The worker never runs on the host, so the
+// test looks at what it would wake up to: a notification on the queue's task.
+
+#include <DispatchQueue.hpp>
+
+static host::Task* worker;
+
+static uint32_t take_notifications(void)
+{
+	uint32_t count = worker->notification;
+	worker->notification = 0;
+	return count;
+}
+
+// Zero delay: already due when it is added, the compare interrupt must still come
+static void test_zero_delay(DispatchQueue& queue)
+{
+	take_notifications();
+
+	auto handle = queue.dispatch_after([]{}, 0);
+	assert(handle);
+
+	// Not notified from the task itself -- the timer ISR is pending and does it
+	assert(take_notifications() == 0);
+
+	host::run_pending_isrs();
+	assert(take_notifications() > 0);
+
+	queue.cancel(handle);
+	host::run_pending_isrs();
+	take_notifications();
+}
+
+// In the future: nothing until the deadline, then exactly when it is due
+static void test_future_deadline(DispatchQueue& queue)
+{
+	take_notifications();
+
+	auto handle = queue.dispatch_on_interval([]{}, 1000);
+	assert(handle);
+
+	// The first run of an interval item is due straight away
+	host::run_pending_isrs();
+	assert(take_notifications() > 0);
+
+	auto later = queue.dispatch_after([]{}, 5000);
+	assert(later);
+
+	queue.cancel(handle);
+	host::run_pending_isrs();
+	take_notifications();
+
+	host::advance_us(4990);
+	assert(take_notifications() == 0);
+
+	host::advance_us(20);
+	assert(take_notifications() > 0);
+
+	queue.cancel(later);
+}
+
+// The new head is earlier than the compare that is already armed for the old one
+static void test_earlier_head(DispatchQueue& queue)
+{
+	auto slow = queue.dispatch_after([]{}, 100000);
+	host::run_pending_isrs();
+	take_notifications();
+
+	auto fast = queue.dispatch_after([]{}, 200);
+	assert(fast);
+
+	host::advance_us(190);
+	assert(take_notifications() == 0);
+
+	host::advance_us(20);
+	assert(take_notifications() > 0);
+
+	queue.cancel(fast);
+	queue.cancel(slow);
+}
+
+int main(void)
+{
+	time::HighPrecisionTimer::Instantiate();
+
+	DispatchQueue queue("wakeup");
+	worker = host::last_created_task();
+
+	// Everything below is called from a task other than the worker
+	host::Task other = { "other", 0 };
+	host::set_current_task(&other);
+
+	test_zero_delay(queue);
+	test_future_deadline(queue);
+	test_earlier_head(queue);
+
+	assert(other.notification == 0);
+
+	printf("dispatch_wakeup_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,67 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host stand-in for the Teensy core: Serial prints to stdout, pins do nothing
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "kinetis.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define RISING 3
+#define SERIAL_8N1 0
+
+class HostSerial
+{
+public:
+	void begin(uint32_t baud, uint32_t format = 0) { (void)baud; (void)format; };
+	int available(void) { return 0; };
+	int read(void) { return -1; };
+
+	size_t write(uint8_t byte) { return write(&byte, 1); };
+	size_t write(const uint8_t* buffer, size_t size) { _written += size; return size; };
+
+	void print(const char* text) { fputs(text, stdout); };
+	void println(const char* text) { printf("%s\n", text); };
+
+	size_t written(void) const { return _written; };
+
+private:
+	size_t _written = 0;
+};
+
+extern HostSerial Serial;
+extern HostSerial Serial4;
+
+inline void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+inline void digitalWrite(uint8_t pin, uint8_t value) { (void)pin; (void)value; }
+inline void attachInterrupt(uint8_t pin, void (*function)(void), int mode) { (void)pin; (void)function; (void)mode; }
+void delayMicroseconds(uint32_t us);
@@ -0,0 +1,143 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host stand-in for the FreeRTOS API the firmware under test uses. Tasks are never run:
+// they are host::Task handles with a notification value. Critical sections, scheduler
+// suspension and FromISR masking all take the one recursive lock in host.cpp, which keeps
+// the kernel's mutual exclusion guarantees for tests that use real threads.
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "host.hpp"
+
+#define configMAX_PRIORITIES			( 5 )
+#define configMAX_TASK_NAME_LEN			( 20 )
+#define configTICK_RATE_HZ				( 1000 )
+#define configSUPPORT_STATIC_ALLOCATION	0
+#define configSUPPORT_DYNAMIC_ALLOCATION	1
+#define configASSERT(x) assert(x)
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+typedef host::Task* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE			( ( BaseType_t ) 0 )
+#define pdTRUE			( ( BaseType_t ) 1 )
+#define pdPASS			( pdTRUE )
+#define pdFAIL			( pdFALSE )
+#define portMAX_DELAY	( TickType_t ) 0xffffffffUL
+#define pdMS_TO_TICKS(ms) ( ( TickType_t ) ( ms ) )
+
+//----- Critical sections -----//
+#define taskENTER_CRITICAL() host::lock()
+#define taskEXIT_CRITICAL() host::unlock()
+#define taskENTER_CRITICAL_FROM_ISR() (host::lock(), ( UBaseType_t ) 0)
+#define taskEXIT_CRITICAL_FROM_ISR(x) ((void)(x), host::unlock())
+#define portYIELD_FROM_ISR(x) ((void)(x))
+
+inline void vTaskSuspendAll(void) { host::lock(); }
+inline BaseType_t xTaskResumeAll(void) { host::unlock(); return pdFALSE; }
+
+//----- Tasks -----//
+enum eTaskState
+{
+	eRunning = 0,
+	eReady,
+	eBlocked,
+	eSuspended,
+	eDeleted,
+	eInvalid
+};
+
+#define taskSCHEDULER_SUSPENDED		( ( BaseType_t ) 0 )
+#define taskSCHEDULER_NOT_STARTED	( ( BaseType_t ) 1 )
+#define taskSCHEDULER_RUNNING		( ( BaseType_t ) 2 )
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint16_t stack_depth, void* parameters,
+	UBaseType_t priority, TaskHandle_t* created_task);
+void vTaskDelete(TaskHandle_t task);
+eTaskState eTaskGetState(TaskHandle_t task);
+BaseType_t xTaskGetSchedulerState(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void vTaskDelay(TickType_t ticks);
+
+struct TimeOut_t
+{
+	TickType_t entered;
+};
+
+void vTaskSetTimeOutState(TimeOut_t* time_out);
+BaseType_t xTaskCheckForTimeOut(TimeOut_t* time_out, TickType_t* ticks_to_wait);
+
+//----- Notifications -----//
+enum eNotifyAction
+{
+	eNoAction = 0,
+	eSetBits,
+	eIncrement,
+	eSetValueWithOverwrite,
+	eSetValueWithoutOverwrite
+};
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_task_woken);
+// Never blocks -- returns what the current task has been given so far
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value,
+	TickType_t ticks_to_wait);
+
+//----- Semaphores -----//
+struct HostSemaphore
+{
+	int count;
+	int max;
+};
+
+typedef HostSemaphore* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+// Never blocks
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_priority_task_woken);
+#define xSemaphoreTakeRecursive(semaphore, ticks) ((void)(semaphore), (void)(ticks), pdTRUE)
+#define xSemaphoreGiveRecursive(semaphore) ((void)(semaphore), pdTRUE)
+
+//----- Heap -----//
+void* pvPortMalloc(size_t size);
+void vPortFree(void* ptr);
+
+//----- SystemView -----//
+#define SEGGER_SYSVIEW_RecordEnterISR()
+#define SEGGER_SYSVIEW_RecordExitISR()
+#define SEGGER_SYSVIEW_OnUserStart(id) ((void)(id))
+#define SEGGER_SYSVIEW_OnUserStop(id) ((void)(id))
@@ -0,0 +1,455 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host implementation of the Teensy core and FreeRTOS fakes, see host.hpp
+
+#include <stdlib.h>
+
+#include <board_config.hpp>
+#include <timers/Time.hpp>
+#include <avr/eeprom.h>
+
+extern "C" void ftm0_isr(void);
+
+HostSerial Serial;
+HostSerial Serial4;
+
+volatile uint32_t FTM0_SC = 0;
+volatile uint32_t FTM0_MOD = FTM0_MAX_TICKS - 1;
+volatile uint32_t FTM0_C0SC = 0;
+volatile uint32_t FTM0_C0V = 0;
+
+volatile uint32_t ARM_DEMCR = 0;
+volatile uint32_t ARM_DWT_CTRL = 0;
+
+namespace host
+{
+
+static Task _default_task = { "main", 0 };
+static thread_local Task* _current_task = nullptr;
+static Task* _last_created_task = nullptr;
+static bool _scheduler_running = true;
+
+static bool _pending[NVIC_NUM_INTERRUPTS] = {};
+
+static uint32_t _counter = 0;
+static uint32_t _read_step = 0;
+
+static uint8_t _eeprom[E2END + 1];
+static bool _eeprom_erased = false;
+
+// Function local so that static constructors that allocate can already use it
+static std::recursive_mutex& kernel_lock(void)
+{
+	static std::recursive_mutex mutex;
+	return mutex;
+}
+
+void lock(void)
+{
+	kernel_lock().lock();
+}
+
+void unlock(void)
+{
+	kernel_lock().unlock();
+}
+
+Task* last_created_task(void)
+{
+	return _last_created_task;
+}
+
+Task* current_task(void)
+{
+	return _current_task != nullptr ? _current_task : &_default_task;
+}
+
+void set_current_task(Task* task)
+{
+	_current_task = task;
+}
+
+void set_scheduler_running(bool running)
+{
+	_scheduler_running = running;
+}
+
+bool take_pending(int irq)
+{
+	bool pending = _pending[irq];
+	_pending[irq] = false;
+	return pending;
+}
+
+void run_pending_isrs(void)
+{
+	// The ISR may pend itself again, e.g. for a deadline that is already due
+	for (int i = 0; i < 8 && take_pending(IRQ_FTM0); i++)
+	{
+		ftm0_isr();
+	}
+}
+
+// Moves the counter on without running any interrupt, a wrap leaves TOF set
+static void step_counter(uint32_t ticks)
+{
+	_counter += ticks;
+
+	if (_counter >= FTM0_MAX_TICKS)
+	{
+		_counter -= FTM0_MAX_TICKS;
+		FTM0_SC |= FTM_SC_TOF;
+	}
+}
+
+uint32_t ftm0_read_counter(void)
+{
+	uint32_t ticks = _counter;
+
+	if (_read_step != 0)
+	{
+		step_counter(_read_step);
+	}
+
+	return ticks;
+}
+
+void ftm0_set_counter(uint32_t ticks)
+{
+	_counter = ticks % FTM0_MAX_TICKS;
+}
+
+void ftm0_set_read_step(uint32_t ticks)
+{
+	_read_step = ticks;
+}
+
+void advance_ticks(uint64_t ticks)
+{
+	run_pending_isrs();
+
+	while (ticks > 0)
+	{
+		uint64_t step = std::min<uint64_t>(ticks, FTM0_MAX_TICKS - _counter);
+
+		// Stop at a channel 0 match on the way
+		bool compare = (FTM0_C0SC & FTM_CSC_CHIE) && FTM0_C0V > _counter && FTM0_C0V - _counter <= step;
+
+		if (compare)
+		{
+			step = FTM0_C0V - _counter;
+		}
+
+		_counter += step;
+		ticks -= step;
+
+		if (_counter >= FTM0_MAX_TICKS)
+		{
+			_counter = 0;
+			FTM0_SC |= FTM_SC_TOF;
+			ftm0_isr();
+		}
+
+		if (compare && (FTM0_C0SC & FTM_CSC_CHIE))
+		{
+			FTM0_C0SC |= FTM_CSC_CHF;
+			ftm0_isr();
+		}
+
+		run_pending_isrs();
+	}
+}
+
+void advance_us(uint64_t us)
+{
+	advance_ticks(us * FTM0_TICKS_PER_MICRO);
+}
+
+uint32_t cycle_counter(void)
+{
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	return static_cast<uint64_t>(ns) * (F_CPU / 1000000) / 1000;
+}
+
+uint8_t* eeprom(void)
+{
+	if (!_eeprom_erased)
+	{
+		erase_eeprom();
+	}
+
+	return _eeprom;
+}
+
+void erase_eeprom(void)
+{
+	memset(_eeprom, 0xFF, sizeof(_eeprom));
+	_eeprom_erased = true;
+}
+
+} // end namespace host
+
+//----- Teensy core -----//
+void host_nvic_set_pending(int irq)
+{
+	host::_pending[irq] = true;
+}
+
+void delayMicroseconds(uint32_t us)
+{
+	(void)us;
+}
+
+void eeprom_read_block(void* buf, const void* addr, uint32_t len)
+{
+	memcpy(buf, host::eeprom() + reinterpret_cast<uintptr_t>(addr), len);
+}
+
+void eeprom_write_block(const void* buf, void* addr, uint32_t len)
+{
+	memcpy(host::eeprom() + reinterpret_cast<uintptr_t>(addr), buf, len);
+}
+
+//----- FreeRTOS -----//
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint16_t stack_depth, void* parameters,
+	UBaseType_t priority, TaskHandle_t* created_task)
+{
+	(void)code;
+	(void)stack_depth;
+	(void)parameters;
+	(void)priority;
+
+	auto task = static_cast<host::Task*>(malloc(sizeof(host::Task)));
+	task->name = name;
+	task->notification = 0;
+
+	host::_last_created_task = task;
+
+	if (created_task != nullptr)
+	{
+		*created_task = task;
+	}
+
+	return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+	(void)task;
+}
+
+eTaskState eTaskGetState(TaskHandle_t task)
+{
+	// No task ever runs, so a worker asked to exit is as good as gone
+	(void)task;
+	return eDeleted;
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+	return host::_scheduler_running ? taskSCHEDULER_RUNNING : taskSCHEDULER_NOT_STARTED;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return host::current_task();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	(void)ticks;
+	std::this_thread::yield();
+}
+
+void vTaskSetTimeOutState(TimeOut_t* time_out)
+{
+	time_out->entered = 0;
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t* time_out, TickType_t* ticks_to_wait)
+{
+	// Nothing blocks, so every wait is over straight away
+	(void)time_out;
+	*ticks_to_wait = 0;
+	return pdTRUE;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+	host::lock();
+
+	switch (action)
+	{
+	case eSetBits:
+		task->notification |= value;
+		break;
+
+	case eIncrement:
+		task->notification++;
+		break;
+
+	case eSetValueWithOverwrite:
+	case eSetValueWithoutOverwrite:
+		task->notification = value;
+		break;
+
+	default:
+		break;
+	}
+
+	host::unlock();
+
+	return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+	return xTaskNotify(task, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_task_woken)
+{
+	xTaskNotify(task, 0, eIncrement);
+
+	if (higher_priority_task_woken != nullptr)
+	{
+		*higher_priority_task_woken = pdTRUE;
+	}
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+	(void)ticks_to_wait;
+
+	host::lock();
+
+	host::Task* task = host::current_task();
+	uint32_t value = task->notification;
+
+	if (value != 0)
+	{
+		task->notification = clear_on_exit ? 0 : value - 1;
+	}
+
+	host::unlock();
+
+	return value;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value,
+	TickType_t ticks_to_wait)
+{
+	(void)clear_on_entry;
+	(void)ticks_to_wait;
+
+	host::lock();
+
+	host::Task* task = host::current_task();
+	uint32_t notification = task->notification;
+	task->notification &= ~clear_on_exit;
+
+	host::unlock();
+
+	if (value != nullptr)
+	{
+		*value = notification;
+	}
+
+	return notification != 0 ? pdTRUE : pdFALSE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+	auto semaphore = static_cast<HostSemaphore*>(malloc(sizeof(HostSemaphore)));
+	semaphore->count = 0;
+	semaphore->max = 1;
+	return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+	auto semaphore = xSemaphoreCreateBinary();
+	semaphore->count = 1;
+	return semaphore;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+	free(semaphore);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+	(void)ticks_to_wait;
+
+	host::lock();
+
+	bool taken = semaphore->count > 0;
+
+	if (taken)
+	{
+		semaphore->count--;
+	}
+
+	host::unlock();
+
+	return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+	host::lock();
+
+	bool given = semaphore->count < semaphore->max;
+
+	if (given)
+	{
+		semaphore->count++;
+	}
+
+	host::unlock();
+
+	return given ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_priority_task_woken)
+{
+	if (higher_priority_task_woken != nullptr)
+	{
+		*higher_priority_task_woken = pdTRUE;
+	}
+
+	return xSemaphoreGive(semaphore);
+}
+
+void* pvPortMalloc(size_t size)
+{
+	return malloc(size);
+}
+
+void vPortFree(void* ptr)
+{
+	free(ptr);
+}
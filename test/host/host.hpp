@@ -0,0 +1,72 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Test side controls for the host fakes of the Teensy core and FreeRTOS. Nothing here
+// is scheduled: tasks are just handles with a notification value, interrupts are plain
+// function calls made by the test and a critical section is one global recursive mutex.
+namespace host
+{
+
+struct Task
+{
+	const char* name;
+	uint32_t notification;
+};
+
+// The task xTaskCreate() made last, and the one xTaskGetCurrentTaskHandle() returns
+Task* last_created_task(void);
+Task* current_task(void);
+void set_current_task(Task* task); // per thread, nullptr for the default task
+
+// Critical sections, scheduler suspension and masked interrupts all take this lock
+void lock(void);
+void unlock(void);
+
+// vTaskStartScheduler() has not been called until this is set
+void set_scheduler_running(bool running);
+
+// NVIC_SET_PENDING() only records the request, run_pending_isrs() services FTM0
+bool take_pending(int irq);
+void run_pending_isrs(void);
+
+// FTM0 model, 60MHz ticks. advance_ticks() moves the counter and runs the overflow and
+// channel 0 compare interrupts as they fall due. read_step makes every FTM0_CNT read
+// advance the counter too -- with no interrupt -- to land an overflow between reads.
+uint32_t ftm0_read_counter(void);
+void ftm0_set_counter(uint32_t ticks);
+void ftm0_set_read_step(uint32_t ticks);
+void advance_ticks(uint64_t ticks);
+void advance_us(uint64_t us);
+
+// ARM_DWT_CYCCNT, runs at F_CPU off the host clock
+uint32_t cycle_counter(void);
+
+// Backs eeprom_read_block() / eeprom_write_block(), erased to 0xFF
+uint8_t* eeprom(void);
+void erase_eeprom(void);
+
+} // end namespace host
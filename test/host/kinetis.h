@@ -0,0 +1,67 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host stand-in for the Teensy core kinetis.h: the registers the firmware under test
+// touches are plain variables, FTM0_CNT is read through the counter model in host.cpp.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "host.hpp"
+
+#ifndef F_CPU
+#define F_CPU 180000000
+#endif
+#define F_BUS 60000000
+
+extern volatile uint32_t FTM0_SC;
+extern volatile uint32_t FTM0_MOD;
+extern volatile uint32_t FTM0_C0SC;
+extern volatile uint32_t FTM0_C0V;
+#define FTM0_CNT (host::ftm0_read_counter())
+
+#define FTM_SC_TOF		0x80
+#define FTM_SC_TOIE		0x40
+#define FTM_CSC_CHF		0x80
+#define FTM_CSC_CHIE	0x40
+#define FTM_CSC_MSA		0x10
+
+extern volatile uint32_t ARM_DEMCR;
+extern volatile uint32_t ARM_DWT_CTRL;
+#define ARM_DEMCR_TRCENA		(1 << 24)
+#define ARM_DWT_CTRL_CYCCNTENA	(1 << 0)
+#define ARM_DWT_CYCCNT (host::cycle_counter())
+
+enum IRQ_NUMBER_t
+{
+	IRQ_DMA_CH0 = 0,
+	IRQ_FTM0 = 42,
+	NVIC_NUM_INTERRUPTS = 100
+};
+
+void host_nvic_set_pending(int irq);
+#define NVIC_SET_PENDING(n) host_nvic_set_pending(n)
+#define NVIC_SET_PRIORITY(irqnum, priority) ((void)(irqnum), (void)(priority))
+
+#define __disable_irq() host::lock()
+#define __enable_irq() host::unlock()
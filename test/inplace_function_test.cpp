@@ -0,0 +1,220 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests for InplaceFunction: the stored callable is copied, moved and destroyed exactly
+// as often as it should be and nothing ever reaches operator new. Then the life of a
+// dispatched job -- construct, move into a queue slot, move out, call -- is timed against
+// std::function for small and large captures. The code size side of the comparison is
+// test/size/function_size.cpp, reported at the end of make test.
+
+#include <InplaceFunction.hpp>
+
+using Clock = std::chrono::steady_clock;
+
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+	allocations++;
+
+	void* ptr = malloc(size);
+
+	if (ptr == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept
+{
+	(void)size;
+	free(ptr);
+}
+
+// Counts its own lifetime events
+struct Tracked
+{
+	static int live;
+	static int copies;
+	static int moves;
+
+	int* calls;
+
+	Tracked(int* counter) : calls(counter) { live++; };
+	Tracked(const Tracked& other) : calls(other.calls) { live++; copies++; };
+	Tracked(Tracked&& other) : calls(other.calls) { live++; moves++; };
+	~Tracked() { live--; };
+
+	void operator()(void) const { (*calls)++; };
+};
+int Tracked::live = 0;
+int Tracked::copies = 0;
+int Tracked::moves = 0;
+
+static void test_lifetime(void)
+{
+	int calls = 0;
+	size_t before = allocations;
+
+	{
+		InplaceFunction<void(void), 16> empty;
+		assert(!empty);
+
+		InplaceFunction<void(void), 16> f = Tracked(&calls);
+		assert(f && Tracked::live == 1);
+
+		f();
+		assert(calls == 1);
+
+		// A copy holds its own callable
+		auto copy = f;
+		assert(Tracked::live == 2 && Tracked::copies == 1);
+
+		// A move leaves the source empty and the callable count unchanged
+		auto moved = std::move(f);
+		assert(!f && Tracked::live == 2);
+
+		moved();
+		copy();
+		assert(calls == 3);
+
+		// Assignment destroys what was there first
+		copy = nullptr;
+		assert(!copy && Tracked::live == 1);
+
+		copy = moved;
+		assert(Tracked::live == 2);
+
+		moved = std::move(copy);
+		assert(!copy && Tracked::live == 1);
+
+		moved = [&calls] { calls += 10; };
+		assert(Tracked::live == 0);
+
+		moved();
+		assert(calls == 13);
+	}
+
+	assert(Tracked::live == 0);
+	assert(allocations == before);
+
+	// Return values and arguments pass straight through
+	InplaceFunction<int(int, int), 16> add = [](int a, int b) { return a + b; };
+	assert(add(2, 3) == 5);
+
+	std::unique_ptr<int> owned(new int(7));
+	size_t after_unique = allocations;
+
+	InplaceFunction<int(std::unique_ptr<int>&&), 16> take = [](std::unique_ptr<int>&& p) { return *p; };
+	assert(take(std::move(owned)) == 7);
+	assert(allocations == after_unique);
+}
+
+//-------------------- Benchmark --------------------//
+
+static constexpr size_t ROUNDS = 1000000;
+static constexpr size_t SLOTS = 16;
+
+// Construct, push into a ring slot, pop and call -- what a dispatched job goes through
+template <typename Function, size_t CAPTURE_WORDS>
+static double job_ns(size_t& allocated)
+{
+	Function ring[SLOTS];
+	uint32_t captured[CAPTURE_WORDS];
+	uint64_t sum = 0;
+	uint64_t expected = 0;
+
+	for (size_t i = 0; i < CAPTURE_WORDS; i++)
+	{
+		captured[i] = i;
+	}
+
+	size_t before = allocations;
+	auto start = Clock::now();
+
+	for (size_t n = 0; n < ROUNDS; n++)
+	{
+		captured[0] = n;
+
+		Function job = [captured, &sum] { sum += captured[0] + captured[CAPTURE_WORDS - 1]; };
+
+		ring[n % SLOTS] = std::move(job);
+
+		Function popped = std::move(ring[n % SLOTS]);
+		popped();
+
+		expected += n + captured[CAPTURE_WORDS - 1];
+	}
+
+	double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ROUNDS;
+
+	allocated = allocations - before;
+	assert(sum == expected);
+
+	return ns;
+}
+
+template <size_t CAPTURE_WORDS>
+static void compare(void)
+{
+	// The capture plus the reference to sum
+	constexpr size_t capture_bytes = CAPTURE_WORDS * sizeof(uint32_t) + sizeof(void*);
+	constexpr size_t capacity = (capture_bytes + 7) & ~size_t(7);
+
+	size_t inplace_allocations;
+	size_t std_allocations;
+
+	double inplace = job_ns<InplaceFunction<void(void), capacity>, CAPTURE_WORDS>(inplace_allocations);
+	double standard = job_ns<std::function<void(void)>, CAPTURE_WORDS>(std_allocations);
+
+	printf("  %3zu byte capture  InplaceFunction<%zu> %3zu bytes %6.1f ns %7zu allocs | std::function %3zu bytes %6.1f ns %7zu allocs\n",
+		capture_bytes, capacity, sizeof(InplaceFunction<void(void), capacity>), inplace, inplace_allocations,
+		sizeof(std::function<void(void)>), standard, std_allocations);
+
+	assert(inplace_allocations == 0);
+}
+
+static void benchmark(void)
+{
+	printf("construct + queue + call:\n");
+
+	compare<1>();
+	compare<2>();
+	compare<4>();
+	compare<8>();
+}
+
+int main(void)
+{
+	test_lifetime();
+	benchmark();
+
+	printf("inplace_function_test: OK\n");
+	return 0;
+}
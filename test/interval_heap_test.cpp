@@ -0,0 +1,477 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests for the interval scheduler heap and the IntervalPolicy variants, on simulated
+// time. The worker loop of DispatchQueue is played by run_ready() below and the FTM0
+// model fires the compare interrupt as time is advanced. Last, the time the worker spends
+// in its critical section per run is compared with the std::list scan the heap replaced.
+
+#include <DispatchQueue.hpp>
+
+using Clock = std::chrono::steady_clock;
+
+struct Run
+{
+	uint8_t slot;
+	abs_time_t deadline;
+	abs_time_t start;
+};
+
+static std::vector<Run> runs;
+
+static constexpr uint32_t WORK_CYCLES = 5 * CYCLES_PER_MICRO;
+
+static abs_time_t now_us(void)
+{
+	return time::HighPrecisionTimer::Instance()->get_absolute_time_us();
+}
+
+// The interval half of DispatchQueue::dispatch_thread_handler()
+static size_t run_ready(IntervalDispatchScheduler& scheduler)
+{
+	size_t count = 0;
+
+	while (scheduler.item_ready())
+	{
+		taskENTER_CRITICAL();
+
+		scheduler.disable_scheduler();
+
+		auto* item = scheduler.get_ready_item();
+
+		fp_t work = item->work;
+		uint8_t slot = scheduler.slot_of(item);
+		uint16_t generation = item->generation;
+		bool one_shot = item->one_shot;
+		runs.push_back({ slot, item->deadline, now_us() });
+
+		scheduler.reschedule_item(item);
+		scheduler.invoke_scheduler();
+		scheduler.enable_scheduler();
+
+		taskEXIT_CRITICAL();
+
+		work();
+
+		// Every job takes the same few us of "work"
+		scheduler.record_execution(slot, generation, one_shot, WORK_CYCLES);
+		count++;
+	}
+
+	return count;
+}
+
+static void run_for(IntervalDispatchScheduler& scheduler, abs_time_t us, abs_time_t step_us)
+{
+	for (abs_time_t elapsed = 0; elapsed < us; elapsed += step_us)
+	{
+		host::advance_us(step_us);
+		run_ready(scheduler);
+	}
+}
+
+static DispatchHandle add(IntervalDispatchScheduler& scheduler, abs_time_t interval, abs_time_t delay,
+	IntervalPolicy policy = IntervalPolicy::RELATIVE)
+{
+	taskENTER_CRITICAL();
+
+	scheduler.disable_scheduler();
+	auto handle = scheduler.add_item([]{}, interval, delay, policy, false);
+	scheduler.invoke_scheduler();
+	scheduler.enable_scheduler();
+
+	taskEXIT_CRITICAL();
+
+	return handle;
+}
+
+static IntervalStats stats_of(const IntervalDispatchScheduler& scheduler, const DispatchHandle& handle)
+{
+	IntervalProfile profile;
+	bool found = scheduler.profile(handle.slot(), profile);
+	assert(found);
+	return profile.stats;
+}
+
+// Full table of distinct periods: items come off the heap in deadline order and each
+// runs as often as its period allows
+static void test_heap_order(DispatchQueue* owner)
+{
+	IntervalDispatchScheduler scheduler(owner);
+	DispatchHandle handles[MAX_INTERVAL_ITEMS];
+
+	constexpr abs_time_t STEP_US = 10;
+	constexpr abs_time_t DURATION_US = 200000;
+
+	runs.clear();
+
+	for (size_t i = 0; i < MAX_INTERVAL_ITEMS; i++)
+	{
+		// Added in reverse period order to make the heap work for it
+		abs_time_t interval = 1000 + 137 * (MAX_INTERVAL_ITEMS - i);
+		handles[i] = add(scheduler, interval, interval);
+		assert(handles[i]);
+	}
+
+	assert(!add(scheduler, 1000, 0));
+
+	run_for(scheduler, DURATION_US, STEP_US);
+
+	abs_time_t previous = 0;
+
+	for (auto& run : runs)
+	{
+		assert(run.deadline >= previous);
+		assert(run.start >= run.deadline);
+		assert(run.start - run.deadline <= STEP_US);
+		previous = run.deadline;
+	}
+
+	for (size_t i = 0; i < MAX_INTERVAL_ITEMS; i++)
+	{
+		abs_time_t interval = 1000 + 137 * (MAX_INTERVAL_ITEMS - i);
+		auto stats = stats_of(scheduler, handles[i]);
+
+		// RELATIVE adds up to a step of lateness to every period
+		assert(stats.runs <= DURATION_US / interval);
+		assert(stats.runs >= DURATION_US / (interval + STEP_US) - 1);
+		assert(stats.max_lateness <= STEP_US);
+	}
+
+	printf("heap order: %zu runs of %zu items in deadline order\n", runs.size(), MAX_INTERVAL_ITEMS);
+}
+
+// Removal from the middle of the heap, stale handles and keeping phase on a new interval
+static void test_cancel_and_change(DispatchQueue* owner)
+{
+	IntervalDispatchScheduler scheduler(owner);
+
+	auto fast = add(scheduler, 300, 300, IntervalPolicy::CATCH_UP);
+	auto middle = add(scheduler, 700, 700, IntervalPolicy::CATCH_UP);
+	auto slow = add(scheduler, 1100, 1100, IntervalPolicy::CATCH_UP);
+
+	run_for(scheduler, 5000, 10);
+
+	taskENTER_CRITICAL();
+	bool removed = scheduler.remove_item(middle.slot(), middle.generation());
+	bool removed_twice = scheduler.remove_item(middle.slot(), middle.generation());
+	scheduler.invoke_scheduler();
+	taskEXIT_CRITICAL();
+
+	assert(removed && !removed_twice);
+
+	runs.clear();
+	run_for(scheduler, 5000, 10);
+
+	for (auto& run : runs)
+	{
+		assert(run.slot != middle.slot());
+	}
+
+	// The freed slot is reused under a new generation, the old handle stays dead
+	auto reused = add(scheduler, 900, 900);
+	assert(reused.slot() == middle.slot());
+	assert(reused.generation() != middle.generation());
+	assert(!scheduler.change_interval(middle.slot(), middle.generation(), 100));
+
+	// A periodic item can not be given a zero period
+	assert(!add(scheduler, 0, 0));
+	assert(!scheduler.change_interval(reused.slot(), reused.generation(), 0));
+
+	// The running period is swapped for the new one, the phase is kept
+	runs.clear();
+	run_for(scheduler, 1100, 10);
+
+	abs_time_t last_deadline = 0;
+
+	for (auto& run : runs)
+	{
+		if (run.slot == slow.slot())
+		{
+			last_deadline = run.deadline;
+		}
+	}
+
+	assert(last_deadline != 0);
+
+	taskENTER_CRITICAL();
+	bool changed = scheduler.change_interval(slow.slot(), slow.generation(), 500);
+	scheduler.invoke_scheduler();
+	taskEXIT_CRITICAL();
+
+	assert(changed);
+
+	runs.clear();
+	run_for(scheduler, 2000, 10);
+
+	std::vector<abs_time_t> deadlines;
+
+	for (auto& run : runs)
+	{
+		if (run.slot == slow.slot())
+		{
+			deadlines.push_back(run.deadline);
+		}
+	}
+
+	assert(deadlines.size() >= 3);
+
+	for (size_t i = 0; i < deadlines.size(); i++)
+	{
+		assert(deadlines[i] == last_deadline + (i + 1) * 500);
+	}
+
+	(void)fast;
+}
+
+// The worker is held off for 3.5 periods, then each policy recovers its own way
+static void test_policies(DispatchQueue* owner)
+{
+	IntervalDispatchScheduler scheduler(owner);
+
+	constexpr abs_time_t INTERVAL = 1000;
+	abs_time_t start = now_us();
+
+	auto relative = add(scheduler, INTERVAL, INTERVAL, IntervalPolicy::RELATIVE);
+	auto catch_up = add(scheduler, INTERVAL, INTERVAL, IntervalPolicy::CATCH_UP);
+	auto skip = add(scheduler, INTERVAL, INTERVAL, IntervalPolicy::SKIP);
+
+	// Nothing runs while the worker is stalled
+	host::advance_us(3500);
+	run_ready(scheduler);
+
+	assert(stats_of(scheduler, relative).runs == 1);
+	assert(stats_of(scheduler, relative).overruns == 1);
+
+	// Every missed period runs back to back
+	assert(stats_of(scheduler, catch_up).runs == 3);
+	assert(stats_of(scheduler, catch_up).skipped == 0);
+
+	// The missed periods are dropped
+	assert(stats_of(scheduler, skip).runs == 1);
+	assert(stats_of(scheduler, skip).skipped == 2);
+
+	// CATCH_UP and SKIP are back on the original phase, RELATIVE has drifted by the stall
+	runs.clear();
+	run_for(scheduler, 900, 10);
+
+	bool relative_ran = false;
+
+	for (auto& run : runs)
+	{
+		if (run.slot == relative.slot())
+		{
+			relative_ran = true;
+		}
+		else
+		{
+			assert(run.deadline == start + 4 * INTERVAL);
+		}
+	}
+
+	assert(!relative_ran);
+	assert(stats_of(scheduler, catch_up).runs == 4);
+	assert(stats_of(scheduler, skip).runs == 2);
+
+	run_for(scheduler, 200, 10);
+	assert(stats_of(scheduler, relative).runs == 2);
+}
+
+// A one-shot item frees its slot before it runs, its numbers land in the one-shot bucket
+static void test_one_shot_stats(DispatchQueue* owner)
+{
+	IntervalDispatchScheduler scheduler(owner);
+
+	taskENTER_CRITICAL();
+	auto once = scheduler.add_item([]{}, 500, 500, IntervalPolicy::RELATIVE, true);
+	auto twice = scheduler.add_item([]{}, 800, 800, IntervalPolicy::RELATIVE, true);
+	scheduler.invoke_scheduler();
+	taskEXIT_CRITICAL();
+
+	assert(once && twice);
+
+	run_for(scheduler, 1000, 10);
+
+	IntervalProfile profile;
+	assert(!scheduler.profile(once.slot(), profile));
+	assert(!scheduler.profile(twice.slot(), profile));
+
+	const IntervalStats& stats = scheduler.one_shot_stats();
+	assert(stats.runs == 2);
+	assert(stats.overruns == 0);
+	assert(stats.max_lateness <= 10);
+	assert(stats.execution.total_cycles == 2 * WORK_CYCLES);
+	assert(stats.execution.max_cycles == WORK_CYCLES);
+	assert(stats.deadline_misses == 0);
+}
+
+//-------------------- Benchmark --------------------//
+
+// The scheduler as it was before the heap: an unsorted list scanned for the earliest
+// deadline on every reschedule. It reads the time as often as the heap path does, the
+// heap path also keeps the lateness statistics.
+class ListScheduler
+{
+public:
+	struct Item
+	{
+		fp_t work;
+		abs_time_t interval;
+		abs_time_t deadline;
+	};
+
+	void add_item(abs_time_t interval, abs_time_t deadline)
+	{
+		_items.push_back({ []{}, interval, deadline });
+		_next = &_items.front();
+	}
+
+	void invoke_scheduler(abs_time_t now)
+	{
+		// The real one read the time here, the value is ignored to keep every item due
+		(void)now_us();
+
+		for (auto& item : _items)
+		{
+			if (item.deadline < _next->deadline)
+			{
+				_next = &item;
+			}
+		}
+
+		_ready = now >= _next->deadline;
+	}
+
+	bool ready(void) const { return _ready; };
+	Item* next(void) { return _next; };
+
+private:
+	std::list<Item> _items;
+	Item* _next = nullptr;
+	bool _ready = false;
+};
+
+static constexpr size_t OPERATIONS = 200000;
+
+// Time is frozen well past every deadline, so with CATCH_UP every item stays due and
+// each pass through the loop is one pick plus one reschedule
+static double heap_ns(DispatchQueue* owner, size_t items)
+{
+	IntervalDispatchScheduler scheduler(owner);
+
+	for (size_t i = 0; i < items; i++)
+	{
+		add(scheduler, 1, 0, IntervalPolicy::CATCH_UP);
+	}
+
+	host::advance_us(OPERATIONS + 1000);
+
+	taskENTER_CRITICAL();
+	scheduler.invoke_scheduler();
+	taskEXIT_CRITICAL();
+
+	auto start = Clock::now();
+
+	for (size_t i = 0; i < OPERATIONS; i++)
+	{
+		taskENTER_CRITICAL();
+
+		scheduler.disable_scheduler();
+		auto* item = scheduler.get_ready_item();
+		fp_t work = item->work;
+		scheduler.reschedule_item(item);
+		scheduler.invoke_scheduler();
+		scheduler.enable_scheduler();
+
+		taskEXIT_CRITICAL();
+
+		assert(scheduler.item_ready());
+	}
+
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / OPERATIONS;
+}
+
+static double list_ns(size_t items)
+{
+	ListScheduler scheduler;
+	abs_time_t now = now_us();
+
+	for (size_t i = 0; i < items; i++)
+	{
+		scheduler.add_item(1, now);
+	}
+
+	now += OPERATIONS + 1000;
+
+	taskENTER_CRITICAL();
+	scheduler.invoke_scheduler(now);
+	taskEXIT_CRITICAL();
+
+	auto start = Clock::now();
+
+	for (size_t i = 0; i < OPERATIONS; i++)
+	{
+		taskENTER_CRITICAL();
+
+		auto* item = scheduler.next();
+		fp_t work = item->work;
+		(void)now_us();
+		item->deadline += item->interval;
+		scheduler.invoke_scheduler(now);
+
+		taskEXIT_CRITICAL();
+
+		assert(scheduler.ready());
+	}
+
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / OPERATIONS;
+}
+
+static void benchmark(DispatchQueue* owner)
+{
+	printf("critical section per run (pick + reschedule):\n");
+
+	for (size_t items : { 1, 2, 4, 8, 16 })
+	{
+		double heap = heap_ns(owner, items);
+		double list = list_ns(items);
+
+		printf("  %2zu items  heap %6.1f ns  list %6.1f ns\n", items, heap, list);
+	}
+}
+
+int main(void)
+{
+	time::HighPrecisionTimer::Instantiate();
+
+	// Owns the handles and takes the compare interrupt's notify, its worker never runs
+	DispatchQueue owner("owner");
+
+	test_heap_order(&owner);
+	test_cancel_and_change(&owner);
+	test_policies(&owner);
+	test_one_shot_stats(&owner);
+	benchmark(&owner);
+
+	printf("interval_heap_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,471 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests for the loaned topics. The slot reference counts and the missed sample counts are
+// checked single threaded, then a publisher and two subscribers race on real threads: a
+// slot that is rewritten while a subscriber still holds its Loan shows up as a torn batch.
+// Last, publish plus read is timed against the copying Publisher / Subscriber for a range
+// of message sizes.
+
+#include <Messenger.hpp>
+
+// Every topic in MESSENGER_TOPICS is copied, so the loan path gets a stand-in with the
+// gyro_batch layout. It borrows the gyro_batch id for the stats and the notification bit.
+struct loaned_batch_s : gyro_batch_s
+{
+};
+
+namespace messenger
+{
+
+template <>
+struct topic_traits<loaned_batch_s>
+{
+	static constexpr TopicId id = gyro_batch_s_id;
+	static constexpr size_t depth = 4;
+	static constexpr TopicKind kind = TopicKind::LOAN;
+	static constexpr const char* name = "loaned_batch_s";
+};
+
+} // end namespace messenger
+
+static constexpr size_t SLOTS = messenger::topic_traits<loaned_batch_s>::depth;
+
+using Clock = std::chrono::steady_clock;
+
+// Every field of the batch carries the same value, exact in a float below 2^24
+static void fill(loaned_batch_s& batch, uint32_t n)
+{
+	batch.timestamp = n;
+	batch.sample_interval = n;
+	batch.count = n & 0xFF;
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		batch.x[i] = n & 0xFFFFFF;
+		batch.y[i] = n & 0xFFFFFF;
+		batch.z[i] = n & 0xFFFFFF;
+	}
+}
+
+static bool consistent(const loaned_batch_s& batch)
+{
+	uint32_t n = batch.timestamp;
+
+	if (batch.sample_interval != n || batch.count != (n & 0xFF))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		float value = n & 0xFFFFFF;
+
+		if (batch.x[i] != value || batch.y[i] != value || batch.z[i] != value)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void test_slot_recycling(void)
+{
+	messenger::LoanedPublisher<loaned_batch_s> publisher;
+	messenger::LoanedSubscriber<loaned_batch_s> first;
+	messenger::LoanedSubscriber<loaned_batch_s> second;
+
+	// Nothing published yet
+	assert(!first.updated());
+	assert(!first.get());
+
+	// A cancelled slot is free again straight away
+	loaned_batch_s* slots[SLOTS];
+
+	for (size_t i = 0; i < SLOTS; i++)
+	{
+		slots[i] = publisher.loan();
+		assert(slots[i] != nullptr);
+	}
+
+	assert(publisher.loan() == nullptr);
+
+	for (size_t i = 0; i < SLOTS; i++)
+	{
+		publisher.cancel(slots[i]);
+	}
+
+	assert(!first.updated());
+
+	// The file keeps the newest slot, each Loan pins the slot it was taken on
+	loaned_batch_s* batch = publisher.loan();
+	fill(*batch, 1);
+	publisher.publish(batch);
+
+	assert(first.updated());
+	auto loan_1 = first.get();
+	assert(loan_1 && loan_1->timestamp == 1);
+	assert(!first.updated());
+
+	batch = publisher.loan();
+	assert(batch != &*loan_1);
+	fill(*batch, 2);
+	publisher.publish(batch);
+
+	auto loan_2 = second.get();
+	assert(loan_2 && loan_2->timestamp == 2);
+
+	// Slot 1 is on loan, slot 2 is the newest and on loan. The rest can be filled.
+	size_t free = 0;
+
+	for (size_t i = 0; i < SLOTS; i++)
+	{
+		slots[i] = publisher.loan();
+		free += slots[i] != nullptr;
+	}
+
+	assert(free == SLOTS - 2);
+
+	for (size_t i = 0; i < SLOTS; i++)
+	{
+		if (slots[i] != nullptr)
+		{
+			assert(slots[i] != &*loan_1 && slots[i] != &*loan_2);
+			publisher.cancel(slots[i]);
+		}
+	}
+
+	// Releasing the last Loan on an old slot recycles it, the newest stays pinned
+	const loaned_batch_s* old_slot = &*loan_1;
+	loan_1.release();
+	assert(!loan_1);
+
+	free = 0;
+
+	for (size_t i = 0; i < SLOTS; i++)
+	{
+		slots[i] = publisher.loan();
+		free += slots[i] != nullptr;
+	}
+
+	assert(free == SLOTS - 1);
+
+	bool recycled = false;
+
+	for (size_t i = 0; i < SLOTS; i++)
+	{
+		if (slots[i] != nullptr)
+		{
+			recycled |= slots[i] == old_slot;
+			publisher.cancel(slots[i]);
+		}
+	}
+
+	assert(recycled);
+
+	// Moving a Loan moves the reference, it is not taken twice
+	messenger::Loan<loaned_batch_s> moved = std::move(loan_2);
+	assert(!loan_2 && moved && moved->timestamp == 2);
+	moved.release();
+
+	// A registered subscriber is notified on commit
+	host::Task task = { "loan", 0 };
+	assert(first.register_task(&task));
+
+	batch = publisher.loan();
+	fill(*batch, 3);
+	publisher.publish(batch);
+
+	assert(task.notification & (1U << messenger::gyro_batch_s_id));
+	assert(first.get()->timestamp == 3);
+}
+
+// Only the newest slot is handed out, commits a subscriber never saw count as missed
+// for it and for the topic
+static void test_missed(void)
+{
+	messenger::LoanedPublisher<loaned_batch_s> publisher;
+	messenger::LoanedSubscriber<loaned_batch_s> subscriber;
+
+	auto& stats = messenger::TOPIC_STATS[messenger::gyro_batch_s_id];
+	uint32_t topic_missed = stats.missed;
+
+	auto publish = [&publisher](uint32_t n)
+	{
+		loaned_batch_s* batch = publisher.loan();
+		fill(*batch, n);
+		publisher.publish(batch);
+	};
+
+	publish(10);
+	assert(subscriber.get()->timestamp == 10);
+	assert(subscriber.missed() == 0);
+
+	// Reading again without a publish in between is not a miss
+	assert(subscriber.get()->timestamp == 10);
+	assert(subscriber.missed() == 0);
+
+	publish(11);
+	publish(12);
+	publish(13);
+	assert(subscriber.get()->timestamp == 13);
+	assert(subscriber.missed() == 2);
+	assert(stats.missed == topic_missed + 2);
+
+	publish(14);
+	assert(subscriber.get()->timestamp == 14);
+	assert(subscriber.missed() == 2);
+}
+
+// Subscribers hold each Loan for a while. The publisher must never be handed a slot
+// that is still on loan, and with SLOTS covering every holder it never runs dry.
+static void test_loan_stress(void)
+{
+	constexpr uint32_t BATCHES = 100000;
+	constexpr size_t READERS = SLOTS - 2;
+
+	messenger::LoanedPublisher<loaned_batch_s> publisher;
+
+	std::atomic<size_t> started {0};
+	std::atomic<bool> done {false};
+	std::atomic<uint64_t> torn {0};
+	std::atomic<uint64_t> reads {0};
+	std::vector<std::thread> readers;
+
+	for (size_t r = 0; r < READERS; r++)
+	{
+		readers.emplace_back([&]
+		{
+			messenger::LoanedSubscriber<loaned_batch_s> subscriber;
+			uint32_t last = 0;
+
+			started++;
+
+			while (!done.load(std::memory_order_relaxed))
+			{
+				if (!subscriber.updated())
+				{
+					continue;
+				}
+
+				auto loan = subscriber.get();
+
+				// Hold the loan across a few publishes, then check it was left alone
+				std::this_thread::yield();
+
+				if (!consistent(*loan) || loan->timestamp < last)
+				{
+					torn++;
+				}
+
+				last = loan->timestamp;
+				reads++;
+			}
+		});
+	}
+
+	while (started < READERS)
+	{
+		std::this_thread::yield();
+	}
+
+	uint64_t exhausted = 0;
+
+	for (uint32_t n = 1; n <= BATCHES; n++)
+	{
+		// Let the subscribers get a word in
+		if (n % 4 == 0)
+		{
+			std::this_thread::yield();
+		}
+
+		loaned_batch_s* batch = publisher.loan();
+
+		if (batch == nullptr)
+		{
+			exhausted++;
+			continue;
+		}
+
+		fill(*batch, n);
+		publisher.publish(batch);
+	}
+
+	done = true;
+
+	for (auto& reader : readers)
+	{
+		reader.join();
+	}
+
+	printf("loan stress: %u batches, %llu loans read by %zu subscribers, %llu torn, %llu pool empty\n",
+		BATCHES, (unsigned long long)reads.load(), READERS, (unsigned long long)torn.load(),
+		(unsigned long long)exhausted);
+
+	assert(torn == 0);
+	assert(exhausted == 0);
+	assert(reads > BATCHES / 100);
+}
+
+//-------------------- Benchmark --------------------//
+
+// Stand-in topics of a given size. They borrow an existing topic id, which only feeds
+// the shared TopicStats.
+template <size_t N>
+struct CopiedBlob
+{
+	uint8_t data[N];
+};
+
+template <size_t N>
+struct LoanedBlob
+{
+	uint8_t data[N];
+};
+
+namespace messenger
+{
+
+template <size_t N>
+struct topic_traits<CopiedBlob<N>>
+{
+	static constexpr TopicId id = memory_status_s_id;
+	static constexpr size_t depth = 1;
+	static constexpr TopicKind kind = TopicKind::COPY;
+	static constexpr const char* name = "CopiedBlob";
+};
+
+template <size_t N>
+struct topic_traits<LoanedBlob<N>>
+{
+	static constexpr TopicId id = memory_status_s_id;
+	static constexpr size_t depth = 4;
+	static constexpr TopicKind kind = TopicKind::LOAN;
+	static constexpr const char* name = "LoanedBlob";
+};
+
+} // end namespace messenger
+
+static constexpr uint32_t ROUNDS = 200000;
+
+static uint64_t expected_sum(void)
+{
+	uint64_t sum = 0;
+
+	for (uint32_t n = 0; n < ROUNDS; n++)
+	{
+		sum += 2 * (n & 0xFF);
+	}
+
+	return sum;
+}
+
+// The publisher writes every byte of the message, the subscriber reads two of them.
+// The copy path then moves the whole message twice, the loan path not at all. On the
+// host the loan path takes the fake scheduler lock (a mutex) twice per round to the copy
+// path's once, which is what the small messages measure -- on the target that is a
+// counter increment.
+template <size_t N>
+static double copy_ns(void)
+{
+	messenger::Publisher<CopiedBlob<N>> publisher;
+	messenger::Subscriber<CopiedBlob<N>> subscriber;
+
+	static CopiedBlob<N> message;
+	uint64_t sum = 0;
+
+	auto start = Clock::now();
+
+	for (uint32_t n = 0; n < ROUNDS; n++)
+	{
+		memset(message.data, n, N);
+		publisher.publish(message);
+
+		auto data = subscriber.get();
+		sum += data.data[0] + data.data[N - 1];
+	}
+
+	auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+	assert(sum == expected_sum());
+	return elapsed / ROUNDS;
+}
+
+template <size_t N>
+static double loan_ns(void)
+{
+	messenger::LoanedPublisher<LoanedBlob<N>> publisher;
+	messenger::LoanedSubscriber<LoanedBlob<N>> subscriber;
+
+	uint64_t sum = 0;
+
+	auto start = Clock::now();
+
+	for (uint32_t n = 0; n < ROUNDS; n++)
+	{
+		auto message = publisher.loan();
+		memset(message->data, n, N);
+		publisher.publish(message);
+
+		auto data = subscriber.get();
+		sum += data->data[0] + data->data[N - 1];
+	}
+
+	auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+	assert(sum == expected_sum());
+	return elapsed / ROUNDS;
+}
+
+template <size_t N>
+static void compare(void)
+{
+	double copy = copy_ns<N>();
+	double loan = loan_ns<N>();
+
+	printf("  %5zu bytes  copy %8.1f ns  loan %8.1f ns  %5.2fx\n", N, copy, loan, copy / loan);
+}
+
+static void benchmark(void)
+{
+	printf("publish + read, one subscriber:\n");
+
+	compare<16>();
+	compare<64>();
+	compare<sizeof(loaned_batch_s)>();
+	compare<1024>();
+	compare<4096>();
+}
+
+int main(void)
+{
+	time::HighPrecisionTimer::Instantiate();
+
+	test_slot_recycling();
+	test_missed();
+	test_loan_stress();
+	benchmark();
+
+	printf("loan_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,177 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests for the generated messages.hpp. The constexpr field tables are checked against
+// offsetof for a couple of layouts by hand, then every topic in MESSENGER_TOPICS is
+// checked for a consistent table (ascending offsets inside the struct, sizes adding up
+// to serialized_size) and for a serialize / deserialize round trip.
+
+#include <Messenger.hpp>
+
+using messages::FieldInfo;
+using messages::FieldType;
+using messages::message_metadata;
+
+static size_t type_size(FieldType type)
+{
+	switch (type)
+	{
+	case FieldType::BOOL:
+	case FieldType::UINT8:
+	case FieldType::INT8:
+		return 1;
+
+	case FieldType::UINT16:
+	case FieldType::INT16:
+		return 2;
+
+	case FieldType::UINT32:
+	case FieldType::INT32:
+	case FieldType::FLOAT32:
+		return 4;
+
+	default:
+		return 8;
+	}
+}
+
+static size_t field_bytes(const FieldInfo& field)
+{
+	return type_size(field.type) * (field.count ? field.count : 1);
+}
+
+static void check_field(const FieldInfo& field, const char* name, FieldType type, uint16_t count, size_t offset)
+{
+	assert(strcmp(field.name, name) == 0);
+	assert(field.type == type);
+	assert(field.count == count);
+	assert(field.offset == offset);
+}
+
+static void test_offsets(void)
+{
+	using meta = message_metadata<gyro_raw_data_s>;
+	static_assert(meta::field_count == 5, "sensor_xyz has 5 fields");
+
+	check_field(meta::fields()[0], "timestamp", FieldType::UINT64, 0, offsetof(gyro_raw_data_s, timestamp));
+	check_field(meta::fields()[1], "temperature", FieldType::FLOAT32, 0, offsetof(gyro_raw_data_s, temperature));
+	check_field(meta::fields()[2], "x", FieldType::FLOAT32, 0, offsetof(gyro_raw_data_s, x));
+	check_field(meta::fields()[3], "y", FieldType::FLOAT32, 0, offsetof(gyro_raw_data_s, y));
+	check_field(meta::fields()[4], "z", FieldType::FLOAT32, 0, offsetof(gyro_raw_data_s, z));
+
+	// Arrays and a byte between words, the struct is reordered for alignment
+	using batch = message_metadata<gyro_batch_s>;
+	static_assert(batch::field_count == 6, "gyro_batch has 6 fields");
+
+	check_field(batch::fields()[0], "timestamp", FieldType::UINT64, 0, offsetof(gyro_batch_s, timestamp));
+	check_field(batch::fields()[1], "sample_interval", FieldType::UINT32, 0, offsetof(gyro_batch_s, sample_interval));
+	check_field(batch::fields()[2], "count", FieldType::UINT8, 0, offsetof(gyro_batch_s, count));
+	check_field(batch::fields()[3], "x", FieldType::FLOAT32, 16, offsetof(gyro_batch_s, x));
+	check_field(batch::fields()[4], "y", FieldType::FLOAT32, 16, offsetof(gyro_batch_s, y));
+	check_field(batch::fields()[5], "z", FieldType::FLOAT32, 16, offsetof(gyro_batch_s, z));
+
+	// Usable in constant expressions
+	static_assert(batch::fields()[3].offset == offsetof(gyro_batch_s, x), "constexpr field table");
+}
+
+// Every topic: the table describes the struct, serialize() writes the fields in table
+// order and deserialize() puts them back
+template <typename T>
+static void check_topic(void)
+{
+	using meta = message_metadata<T>;
+
+	const FieldInfo* fields = meta::fields();
+	size_t total = 0;
+
+	for (size_t i = 0; i < meta::field_count; i++)
+	{
+		assert(fields[i].offset % type_size(fields[i].type) == 0);
+		assert(fields[i].offset + field_bytes(fields[i]) <= sizeof(T));
+
+		// No two fields overlap
+		for (size_t j = 0; j < i; j++)
+		{
+			bool apart = fields[j].offset + field_bytes(fields[j]) <= fields[i].offset ||
+				fields[i].offset + field_bytes(fields[i]) <= fields[j].offset;
+			assert(apart);
+		}
+
+		total += field_bytes(fields[i]);
+	}
+
+	assert(total == meta::serialized_size);
+
+	std::mt19937 random(sizeof(T));
+
+	T msg;
+	memset(&msg, 0, sizeof(msg));
+
+	auto bytes = reinterpret_cast<uint8_t*>(&msg);
+
+	for (size_t i = 0; i < meta::field_count; i++)
+	{
+		for (size_t b = 0; b < field_bytes(fields[i]); b++)
+		{
+			// bools stay 0 or 1
+			bytes[fields[i].offset + b] = fields[i].type == FieldType::BOOL ? random() & 1 : random();
+		}
+	}
+
+	uint8_t buffer[meta::serialized_size];
+	assert(messages::serialize(msg, buffer) == meta::serialized_size);
+
+	// Tightly packed in table order
+	size_t position = 0;
+
+	for (size_t i = 0; i < meta::field_count; i++)
+	{
+		assert(memcmp(buffer + position, bytes + fields[i].offset, field_bytes(fields[i])) == 0);
+		position += field_bytes(fields[i]);
+	}
+
+	T back;
+	memset(&back, 0, sizeof(back));
+	assert(messages::deserialize(back, buffer) == meta::serialized_size);
+
+	for (size_t i = 0; i < meta::field_count; i++)
+	{
+		size_t offset = fields[i].offset;
+		assert(memcmp(reinterpret_cast<uint8_t*>(&back) + offset, bytes + offset, field_bytes(fields[i])) == 0);
+	}
+}
+
+static void test_topics(void)
+{
+#define CHECK_TOPIC(type, depth, kind) check_topic<type>();
+	MESSENGER_TOPICS(CHECK_TOPIC)
+#undef CHECK_TOPIC
+}
+
+int main(void)
+{
+	test_offsets();
+	test_topics();
+
+	printf("messages_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,251 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests for MpscRing. Several producers push tagged items on real threads while one
+// consumer drains the ring: every item must come out exactly once and in the order its
+// producer pushed it, with a full ring pushing back rather than dropping or overwriting.
+// Throughput is then compared with the mutex guarded deque the dispatch lanes used before.
+
+#include <MpscRing.hpp>
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t DEPTH = 16;
+
+struct Item
+{
+	uint32_t producer;
+	uint32_t sequence;
+};
+
+static void test_single_thread(void)
+{
+	MpscRing<Item, DEPTH> ring;
+	Item item;
+
+	assert(ring.empty());
+	assert(ring.front() == nullptr);
+	assert(!ring.pop(item));
+
+	// Many laps, so every cell is reused with a moving sequence number
+	for (uint32_t lap = 0; lap < 1000; lap++)
+	{
+		for (uint32_t i = 0; i < DEPTH; i++)
+		{
+			assert(ring.push(Item{ lap, i }));
+		}
+
+		// Full -- the push is refused and nothing is overwritten
+		assert(!ring.push(Item{ lap, DEPTH }));
+
+		assert(ring.front() != nullptr && ring.front()->sequence == 0);
+
+		for (uint32_t i = 0; i < DEPTH; i++)
+		{
+			assert(!ring.empty());
+			assert(ring.pop(item));
+			assert(item.producer == lap && item.sequence == i);
+		}
+
+		assert(ring.empty());
+	}
+
+	// Interleaved, never more than half full
+	uint32_t pushed = 0;
+	uint32_t popped = 0;
+
+	for (uint32_t i = 0; i < 10000; i++)
+	{
+		assert(ring.push(Item{ 0, pushed++ }));
+
+		if (i % 2 == 1)
+		{
+			assert(ring.pop(item) && item.sequence == popped++);
+		}
+
+		if (pushed - popped == DEPTH / 2)
+		{
+			while (ring.pop(item))
+			{
+				assert(item.sequence == popped++);
+			}
+		}
+	}
+}
+
+template <typename Queue>
+struct StressResult
+{
+	uint64_t received = 0;
+	uint64_t out_of_order = 0;
+	uint64_t refused = 0;
+	double ns_per_item = 0;
+};
+
+// Producers retry a refused push, so every item must come through
+template <typename Queue>
+static StressResult<Queue> stress(Queue& queue, uint32_t producers, uint32_t items_per_producer)
+{
+	StressResult<Queue> result;
+	std::atomic<uint32_t> ready {0};
+	std::atomic<uint64_t> refused {0};
+	std::vector<std::thread> threads;
+
+	for (uint32_t p = 0; p < producers; p++)
+	{
+		threads.emplace_back([&, p]
+		{
+			uint64_t full = 0;
+
+			ready++;
+
+			while (ready < producers + 1)
+			{
+				std::this_thread::yield();
+			}
+
+			for (uint32_t n = 0; n < items_per_producer; n++)
+			{
+				while (!queue.push(Item{ p, n }))
+				{
+					full++;
+					std::this_thread::yield();
+				}
+			}
+
+			refused += full;
+		});
+	}
+
+	std::vector<uint32_t> next(producers, 0);
+	uint64_t total = static_cast<uint64_t>(producers) * items_per_producer;
+
+	while (ready < producers)
+	{
+		std::this_thread::yield();
+	}
+
+	auto start = Clock::now();
+	ready++;
+
+	Item item;
+
+	while (result.received < total)
+	{
+		if (!queue.pop(item))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		if (item.sequence != next[item.producer])
+		{
+			result.out_of_order++;
+		}
+
+		next[item.producer] = item.sequence + 1;
+		result.received++;
+	}
+
+	result.ns_per_item = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / total;
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	result.refused = refused;
+
+	return result;
+}
+
+// The lane as it was: a bounded deque behind a mutex
+class LockedQueue
+{
+public:
+	bool push(Item&& item)
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+
+		if (_items.size() == DEPTH)
+		{
+			return false;
+		}
+
+		_items.push_back(item);
+		return true;
+	}
+
+	bool pop(Item& item)
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+
+		if (_items.empty())
+		{
+			return false;
+		}
+
+		item = _items.front();
+		_items.pop_front();
+		return true;
+	}
+
+private:
+	std::mutex _mutex;
+	std::deque<Item> _items;
+};
+
+static void test_stress(void)
+{
+	constexpr uint32_t ITEMS = 100000;
+
+	printf("producers -> one consumer, depth %zu:\n", DEPTH);
+
+	for (uint32_t producers : { 1, 2, 4 })
+	{
+		MpscRing<Item, DEPTH> ring;
+		LockedQueue locked;
+
+		auto lock_free = stress(ring, producers, ITEMS);
+		auto mutex = stress(locked, producers, ITEMS);
+
+		printf("  %u producers  ring %6.1f ns/item %8llu refused | mutex + deque %6.1f ns/item %8llu refused\n",
+			producers, lock_free.ns_per_item, (unsigned long long)lock_free.refused,
+			mutex.ns_per_item, (unsigned long long)mutex.refused);
+
+		assert(lock_free.received == static_cast<uint64_t>(producers) * ITEMS);
+		assert(lock_free.out_of_order == 0);
+		assert(ring.empty());
+
+		assert(mutex.received == static_cast<uint64_t>(producers) * ITEMS);
+		assert(mutex.out_of_order == 0);
+	}
+}
+
+int main(void)
+{
+	test_single_thread();
+	test_stress();
+
+	printf("mpsc_ring_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,186 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests for the MPU9250 burst decode. Register images are built from known readings and
+// the decoded sample is compared with the byte at a time decode the word-wise REV16 one
+// replaced. On the host rev16() is the portable fallback, so it is also checked against
+// a plain byte swap.
+
+#include <mpu9250_decode.hpp>
+
+using mpu9250_decode::BURST_READ_BYTES;
+using mpu9250_decode::Sample;
+
+struct Reading
+{
+	int16_t accel[3];
+	int16_t temperature;
+	int16_t gyro[3];
+	uint8_t mag_st1;
+	int16_t mag[3];
+	uint8_t mag_st2;
+};
+
+// The register layout: big endian MPU9250 values, then the AK8963 little endian ones
+static void encode(const Reading& reading, uint8_t* raw)
+{
+	auto put_be = [](uint8_t* bytes, int16_t value)
+	{
+		bytes[0] = static_cast<uint16_t>(value) >> 8;
+		bytes[1] = static_cast<uint16_t>(value) & 0xFF;
+	};
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		put_be(raw + 2 * i, reading.accel[i]);
+		put_be(raw + 8 + 2 * i, reading.gyro[i]);
+	}
+
+	put_be(raw + 6, reading.temperature);
+
+	raw[14] = reading.mag_st1;
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		raw[15 + 2 * i] = static_cast<uint16_t>(reading.mag[i]) & 0xFF;
+		raw[16 + 2 * i] = static_cast<uint16_t>(reading.mag[i]) >> 8;
+	}
+
+	raw[21] = reading.mag_st2;
+}
+
+// One register pair at a time, the way the driver decoded before REV16
+static Sample reference_decode(const uint8_t* raw, float sx, float sy, float sz)
+{
+	auto be = [raw](size_t offset) { return static_cast<int16_t>((raw[offset] << 8) | raw[offset + 1]); };
+	auto le = [raw](size_t offset) { return static_cast<int16_t>((raw[offset + 1] << 8) | raw[offset]); };
+
+	Sample sample;
+	sample.accel_x = be(0) * ACCEL_M_S2_PER_TICK;
+	sample.accel_y = be(2) * ACCEL_M_S2_PER_TICK;
+	sample.accel_z = be(4) * ACCEL_M_S2_PER_TICK;
+	sample.temperature = be(6) / 333.87f + 21.0f;
+	sample.gyro_x = be(8) * RAD_S_PER_TICK;
+	sample.gyro_y = be(10) * RAD_S_PER_TICK;
+	sample.gyro_z = be(12) * RAD_S_PER_TICK;
+	sample.mag_st1 = raw[14];
+	sample.mag_x = le(15) * sx;
+	sample.mag_y = le(17) * sy;
+	sample.mag_z = le(19) * sz;
+	sample.mag_st2 = raw[21];
+
+	return sample;
+}
+
+static void check(const Sample& a, const Sample& b)
+{
+	assert(a.accel_x == b.accel_x && a.accel_y == b.accel_y && a.accel_z == b.accel_z);
+	assert(a.gyro_x == b.gyro_x && a.gyro_y == b.gyro_y && a.gyro_z == b.gyro_z);
+	assert(a.mag_x == b.mag_x && a.mag_y == b.mag_y && a.mag_z == b.mag_z);
+	assert(a.temperature == b.temperature);
+	assert(a.mag_st1 == b.mag_st1 && a.mag_st2 == b.mag_st2);
+}
+
+static void test_rev16(void)
+{
+	assert(mpu9250_decode::rev16(0x11223344) == 0x22114433);
+	assert(mpu9250_decode::rev16(0xFF0080FE) == 0x00FFFE80);
+
+	std::mt19937 random(3);
+
+	for (size_t i = 0; i < 100000; i++)
+	{
+		uint32_t word = random();
+		uint32_t swapped = __builtin_bswap16(word >> 16) << 16 | __builtin_bswap16(word & 0xFFFF);
+		assert(mpu9250_decode::rev16(word) == swapped);
+	}
+
+	uint8_t bytes[2] = { 0x80, 0x01 };
+	assert(mpu9250_decode::be16(bytes) == -32767);
+}
+
+static void test_known_reading(void)
+{
+	// Level and still: 1g on z, a little gyro bias, some field
+	Reading reading = { { 12, -7, 2048 }, 0, { -3, 5, 1 }, 0x01, { 150, -220, 400 }, 0x10 };
+
+	alignas(4) uint8_t raw[BURST_READ_BYTES];
+	encode(reading, raw);
+
+	Sample sample;
+	mpu9250_decode::decode_burst(raw, 1.0f, 1.0f, 1.0f, sample);
+
+	assert(fabsf(sample.accel_z - 9.80665f) < 1e-5f);
+	assert(sample.accel_x == 12 * ACCEL_M_S2_PER_TICK);
+	assert(sample.accel_y == -7 * ACCEL_M_S2_PER_TICK);
+	assert(sample.temperature == 21.0f);
+	assert(sample.gyro_x == -3 * RAD_S_PER_TICK);
+	assert(sample.gyro_y == 5 * RAD_S_PER_TICK);
+	assert(sample.gyro_z == 1 * RAD_S_PER_TICK);
+	assert(sample.mag_x == 150 && sample.mag_y == -220 && sample.mag_z == 400);
+	assert(sample.mag_st1 == 0x01 && sample.mag_st2 == 0x10);
+
+	// Full scale both ways
+	Reading extremes = { { INT16_MAX, INT16_MIN, -1 }, INT16_MIN, { INT16_MIN, INT16_MAX, 0 }, 0xFF,
+		{ INT16_MIN, INT16_MAX, -1 }, 0xFF };
+	encode(extremes, raw);
+
+	mpu9250_decode::decode_burst(raw, 1.0f, 1.0f, 1.0f, sample);
+	check(sample, reference_decode(raw, 1.0f, 1.0f, 1.0f));
+
+	assert(sample.gyro_x == INT16_MIN * RAD_S_PER_TICK);
+	// One tick short of full scale on the positive side
+	assert(fabsf(sample.gyro_y - static_cast<float>(GYRO_FULL_SCALE_RAD_S * 32767 / 32768)) < 1e-4f);
+}
+
+// Random register images, both decodes must agree bit for bit
+static void test_random_images(void)
+{
+	std::mt19937 random(7);
+	alignas(4) uint8_t raw[BURST_READ_BYTES];
+
+	for (size_t i = 0; i < 100000; i++)
+	{
+		for (auto& byte : raw)
+		{
+			byte = random();
+		}
+
+		float sx = 1.0f + (random() % 256 - 128) * 0.5f / 128;
+		float sy = 1.0f + (random() % 256 - 128) * 0.5f / 128;
+		float sz = 1.0f + (random() % 256 - 128) * 0.5f / 128;
+
+		Sample sample;
+		mpu9250_decode::decode_burst(raw, sx, sy, sz, sample);
+		check(sample, reference_decode(raw, sx, sy, sz));
+	}
+}
+
+int main(void)
+{
+	test_rev16();
+	test_known_reading();
+	test_random_images();
+
+	printf("mpu9250_decode_test: OK\n");
+	return 0;
+}
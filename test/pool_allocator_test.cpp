@@ -0,0 +1,235 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests for the fixed block pools. Each size class is drained to exhaustion to check the
+// best fit, the spill into the next class up and the heap fallback, then every block is
+// freed and handed out again. Last, threads allocate and free at random and stamp every
+// block they hold -- a block handed out twice shows up as a foreign stamp.
+
+#include <FreeRTOS.h>
+#include <PoolAllocator.hpp>
+
+#define POOL_SIZE(size, blocks) size,
+static const size_t SIZES[] = { MEMORY_POOLS(POOL_SIZE) };
+#undef POOL_SIZE
+
+#define POOL_BLOCKS(size, blocks) blocks,
+static const size_t BLOCKS[] = { MEMORY_POOLS(POOL_BLOCKS) };
+#undef POOL_BLOCKS
+
+static memory::PoolStats stats_of(size_t pool)
+{
+	memory::PoolStats stats;
+	bool valid = memory::pool_stats(pool, stats);
+	assert(valid);
+	return stats;
+}
+
+static void test_size_classes(void)
+{
+	// The pools must work before the scheduler is started, static constructors use them
+	host::set_scheduler_running(false);
+
+	memory::PoolStats out_of_range;
+	assert(!memory::pool_stats(memory::POOL_COUNT, out_of_range));
+
+	std::vector<void*> held[memory::POOL_COUNT];
+
+	for (size_t pool = 0; pool < memory::POOL_COUNT; pool++)
+	{
+		auto stats = stats_of(pool);
+		assert(stats.block_size == SIZES[pool] && stats.blocks == BLOCKS[pool]);
+		assert(stats.in_use == 0);
+
+		// Anything above the class below lands here
+		size_t smallest = pool == 0 ? 1 : SIZES[pool - 1] + 1;
+
+		for (size_t i = 0; i < BLOCKS[pool]; i++)
+		{
+			size_t size = i % 2 ? SIZES[pool] : smallest;
+			void* block = memory::allocate(size);
+
+			assert(block != nullptr);
+			assert(reinterpret_cast<uintptr_t>(block) % 8 == 0);
+			memset(block, 0xA5, size);
+
+			held[pool].push_back(block);
+		}
+
+		stats = stats_of(pool);
+		assert(stats.in_use == BLOCKS[pool]);
+		assert(stats.high_water == BLOCKS[pool]);
+		assert(stats.failures == 0);
+
+		// Every block is distinct and inside the class
+		std::vector<void*> sorted = held[pool];
+		std::sort(sorted.begin(), sorted.end());
+
+		for (size_t i = 1; i < sorted.size(); i++)
+		{
+			auto gap = static_cast<uint8_t*>(sorted[i]) - static_cast<uint8_t*>(sorted[i - 1]);
+			assert(gap >= static_cast<ptrdiff_t>(SIZES[pool]));
+		}
+	}
+
+	// Every class is exhausted: a miss counts against the best fit and goes to the heap
+	uint32_t exhausted = memory::exhausted_allocations();
+	void* spilled = memory::allocate(SIZES[0]);
+
+	assert(spilled != nullptr);
+	assert(stats_of(0).failures == 1);
+	assert(memory::exhausted_allocations() == exhausted + 1);
+
+	// Larger than the largest class goes straight to the heap
+	uint32_t large = memory::large_allocations();
+	void* big = memory::allocate(SIZES[memory::POOL_COUNT - 1] + 1);
+
+	assert(big != nullptr);
+	assert(memory::large_allocations() == large + 1);
+
+	memory::deallocate(big);
+	memory::deallocate(spilled);
+	memory::deallocate(nullptr);
+
+	// With one block free in the class above, an exhausted class spills into it
+	void* freed = held[2].back();
+	held[2].pop_back();
+	memory::deallocate(freed);
+	assert(stats_of(2).in_use == BLOCKS[2] - 1);
+
+	void* promoted = memory::allocate(SIZES[1]);
+	assert(promoted == freed);
+	assert(stats_of(1).failures == 1);
+	assert(stats_of(2).in_use == BLOCKS[2]);
+	held[2].push_back(promoted);
+
+	// Freed blocks are reused last in, first out and the high water mark stays
+	for (size_t pool = 0; pool < memory::POOL_COUNT; pool++)
+	{
+		for (void* block : held[pool])
+		{
+			memory::deallocate(block);
+		}
+
+		auto stats = stats_of(pool);
+		assert(stats.in_use == 0);
+		assert(stats.high_water == BLOCKS[pool]);
+
+		void* again = memory::allocate(SIZES[pool]);
+		assert(again == held[pool].back());
+		memory::deallocate(again);
+	}
+
+	host::set_scheduler_running(true);
+}
+
+static void test_threads(void)
+{
+	constexpr size_t THREADS = 4;
+	constexpr size_t OPERATIONS = 100000;
+	constexpr size_t HELD = 24;
+
+	std::atomic<uint64_t> foreign {0};
+	std::vector<std::thread> threads;
+
+	for (size_t t = 0; t < THREADS; t++)
+	{
+		threads.emplace_back([&, t]
+		{
+			std::mt19937 random(t);
+			std::uniform_int_distribution<size_t> sizes(sizeof(uint32_t), SIZES[memory::POOL_COUNT - 1]);
+
+			struct Held
+			{
+				uint32_t* block;
+				size_t size;
+			};
+
+			Held held[HELD] = {};
+			uint32_t stamp = (t + 1) << 24;
+
+			for (size_t n = 0; n < OPERATIONS; n++)
+			{
+				Held& slot = held[random() % HELD];
+
+				if (slot.block != nullptr)
+				{
+					for (size_t i = 0; i < slot.size / sizeof(uint32_t); i++)
+					{
+						if (slot.block[i] != stamp + i)
+						{
+							foreign++;
+							break;
+						}
+					}
+
+					memory::deallocate(slot.block);
+					slot.block = nullptr;
+				}
+				else
+				{
+					slot.size = sizes(random) & ~(sizeof(uint32_t) - 1);
+					slot.block = static_cast<uint32_t*>(memory::allocate(slot.size));
+
+					for (size_t i = 0; i < slot.size / sizeof(uint32_t); i++)
+					{
+						slot.block[i] = stamp + i;
+					}
+				}
+
+				if (n % 64 == 0)
+				{
+					std::this_thread::yield();
+				}
+			}
+
+			for (auto& slot : held)
+			{
+				memory::deallocate(slot.block);
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	printf("pool threads: %zu x %zu operations, %llu blocks handed out twice\n", THREADS, OPERATIONS,
+		(unsigned long long)foreign.load());
+
+	assert(foreign == 0);
+
+	for (size_t pool = 0; pool < memory::POOL_COUNT; pool++)
+	{
+		assert(stats_of(pool).in_use == 0);
+	}
+}
+
+int main(void)
+{
+	test_size_classes();
+	test_threads();
+
+	printf("pool_allocator_test: OK\n");
+	return 0;
+}
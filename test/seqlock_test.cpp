@@ -0,0 +1,301 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Stress test for the seqlock DataFile. One publisher and several subscribers run on
+// real threads. Every field of a sample carries its sequence number, so a torn read
+// shows up as a mismatch. The read and write latency is then compared with the critical
+// section file the seqlock replaced.
+
+#include <Messenger.hpp>
+
+static constexpr uint32_t SAMPLES = 200000;
+static constexpr size_t READERS = 3;
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t elapsed_ns(Clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+// Exact in a float as long as it stays below 2^24
+static void fill(accel_raw_data_s& data, uint32_t n)
+{
+	data.timestamp = n;
+	data.x = n & 0xFFFFFF;
+	data.y = n & 0xFFFFFF;
+	data.z = n & 0xFFFFFF;
+	data.temperature = n & 0xFFFFFF;
+}
+
+static bool consistent(const accel_raw_data_s& data)
+{
+	float n = data.timestamp & 0xFFFFFF;
+	return data.x == n && data.y == n && data.z == n && data.temperature == n;
+}
+
+// The data file as it was before the seqlock -- every access in a critical section
+template <typename T>
+class CriticalSectionFile
+{
+public:
+	static void set_data(const T& data)
+	{
+		taskENTER_CRITICAL();
+		_data = data;
+		taskEXIT_CRITICAL();
+	}
+
+	static T get_data(void)
+	{
+		taskENTER_CRITICAL();
+		T data = _data;
+		taskEXIT_CRITICAL();
+		return data;
+	}
+
+private:
+	static T _data;
+};
+template <typename T>
+T CriticalSectionFile<T>::_data {};
+
+struct Latency
+{
+	uint64_t operations = 0;
+	uint64_t total_ns = 0;
+	uint64_t max_ns = 0;
+
+	void record(uint64_t ns)
+	{
+		operations++;
+		total_ns += ns;
+		max_ns = std::max(max_ns, ns);
+	}
+
+	void merge(const Latency& other)
+	{
+		operations += other.operations;
+		total_ns += other.total_ns;
+		max_ns = std::max(max_ns, other.max_ns);
+	}
+};
+
+// One writer publishes SAMPLES samples while READERS threads read as fast as they can.
+// Returns the number of torn or out of order reads.
+template <typename Write, typename Read>
+static uint64_t stress(const char* label, Write write, Read read)
+{
+	std::atomic<bool> done {false};
+	std::atomic<uint64_t> errors {0};
+	Latency write_latency;
+	Latency read_latency[READERS];
+
+	std::vector<std::thread> readers;
+
+	for (size_t r = 0; r < READERS; r++)
+	{
+		readers.emplace_back([&, r]
+		{
+			uint64_t last = 0;
+
+			while (!done.load(std::memory_order_relaxed))
+			{
+				auto start = Clock::now();
+				accel_raw_data_s data = read();
+				read_latency[r].record(elapsed_ns(start));
+
+				if (!consistent(data) || data.timestamp < last)
+				{
+					errors++;
+				}
+
+				last = data.timestamp;
+			}
+		});
+	}
+
+	for (uint32_t n = 1; n <= SAMPLES; n++)
+	{
+		accel_raw_data_s data;
+		fill(data, n);
+
+		auto start = Clock::now();
+		write(data);
+		write_latency.record(elapsed_ns(start));
+	}
+
+	done = true;
+
+	Latency reads;
+
+	for (size_t r = 0; r < READERS; r++)
+	{
+		readers[r].join();
+		reads.merge(read_latency[r]);
+	}
+
+	printf("  %-16s write avg %5llu max %8llu ns | read avg %5llu max %8llu ns | %llu reads\n", label,
+		(unsigned long long)(write_latency.total_ns / write_latency.operations),
+		(unsigned long long)write_latency.max_ns,
+		(unsigned long long)(reads.operations ? reads.total_ns / reads.operations : 0),
+		(unsigned long long)reads.max_ns,
+		(unsigned long long)reads.operations);
+
+	return errors;
+}
+
+static void test_no_torn_reads(void)
+{
+	messenger::Publisher<accel_raw_data_s> publisher;
+
+	uint64_t errors = stress("seqlock",
+		[&](accel_raw_data_s& data) { publisher.publish(data); },
+		[] { messenger::Subscriber<accel_raw_data_s> subscriber; return subscriber.get(); });
+
+	assert(errors == 0);
+
+	// Same load on the file it replaced, for the latency comparison only
+	stress("critical section",
+		[](accel_raw_data_s& data) { CriticalSectionFile<accel_raw_data_s>::set_data(data); },
+		[] { return CriticalSectionFile<accel_raw_data_s>::get_data(); });
+}
+
+static void test_queued_batch(void)
+{
+	messenger::Publisher<gyro_raw_data_s> publisher;
+	messenger::Subscriber<gyro_raw_data_s> subscriber;
+
+	constexpr size_t depth = messenger::topic_traits<gyro_raw_data_s>::depth;
+	gyro_raw_data_s batch[depth];
+	gyro_raw_data_s data = {};
+
+	// Fewer than the depth: every sample, oldest first
+	for (uint32_t n = 1; n <= 5; n++)
+	{
+		data.timestamp = n;
+		publisher.publish(data);
+	}
+
+	size_t count = subscriber.get_batch(batch, depth);
+	assert(count == 5);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		assert(batch[i].timestamp == i + 1);
+	}
+
+	assert(!subscriber.updated());
+	assert(subscriber.missed() == 0);
+
+	// Lapped: the newest depth samples and the rest counted as missed
+	for (uint32_t n = 6; n <= 25; n++)
+	{
+		data.timestamp = n;
+		publisher.publish(data);
+	}
+
+	count = subscriber.get_batch(batch, depth);
+	assert(count == depth);
+	assert(batch[0].timestamp == 25 - depth + 1);
+	assert(batch[depth - 1].timestamp == 25);
+	assert(subscriber.missed() == 20 - depth);
+}
+
+// A batch reader racing the publisher sees every sample exactly once, or counts it missed
+static void test_queued_stress(void)
+{
+	messenger::Publisher<gyro_raw_data_s> publisher;
+	messenger::Subscriber<gyro_raw_data_s> subscriber;
+
+	std::atomic<bool> started {false};
+	std::atomic<bool> done {false};
+	uint64_t received = 0;
+	uint64_t out_of_order = 0;
+
+	std::thread reader([&]
+	{
+		gyro_raw_data_s batch[4];
+		uint64_t last = 0;
+		bool finished = false;
+
+		started = true;
+
+		while (!finished)
+		{
+			finished = done.load();
+
+			size_t count;
+
+			while ((count = subscriber.get_batch(batch, 4)) > 0)
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					out_of_order += batch[i].timestamp <= last;
+					last = batch[i].timestamp;
+				}
+
+				received += count;
+			}
+		}
+	});
+
+	while (!started)
+	{
+		std::this_thread::yield();
+	}
+
+	gyro_raw_data_s data = {};
+
+	for (uint32_t n = 1; n <= SAMPLES; n++)
+	{
+		data.timestamp = n;
+		publisher.publish(data);
+
+		// Roughly the reader's pace, so it both keeps up and gets lapped now and then
+		if (n % 4 == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	done = true;
+	reader.join();
+
+	printf("  queued: %llu of %u received, %u missed\n", (unsigned long long)received, SAMPLES,
+		subscriber.missed());
+
+	assert(out_of_order == 0);
+	assert(received + subscriber.missed() == SAMPLES);
+}
+
+int main(void)
+{
+	time::HighPrecisionTimer::Instantiate();
+
+	test_no_torn_reads();
+	test_queued_batch();
+	test_queued_stress();
+
+	printf("seqlock_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,93 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Code size probe for fp_t, built twice by make test: once with InplaceFunction and once
+// with -DUSE_STD_FUNCTION. Each call site mirrors a dispatch -- a distinct lambda type is
+// wrapped, moved through a queue slot and called -- so the per callable cost of both
+// implementations shows up in the object's text size. Nothing here is run.
+
+#include <InplaceFunction.hpp>
+
+#include <cstdint>
+#include <functional>
+
+#if defined(USE_STD_FUNCTION)
+typedef std::function<void(void)> Function;
+#else
+typedef InplaceFunction<void(void), 16> Function;
+#endif
+
+static constexpr size_t SLOTS = 8;
+
+static Function _slots[SLOTS];
+static size_t _head = 0;
+static size_t _tail = 0;
+
+volatile uint32_t sink;
+
+static void push(Function&& function)
+{
+	_slots[_head++ % SLOTS] = std::move(function);
+}
+
+extern "C" void run_all(void)
+{
+	while (_tail != _head)
+	{
+		Function function = std::move(_slots[_tail++ % SLOTS]);
+		function();
+	}
+}
+
+extern "C" void dispatch_counter(uint32_t* counter)
+{
+	push([counter] { (*counter)++; });
+}
+
+extern "C" void dispatch_value(uint32_t value)
+{
+	push([value] { sink = value; });
+}
+
+extern "C" void dispatch_pair(uint32_t a, uint32_t b)
+{
+	push([a, b] { sink = a + b; });
+}
+
+extern "C" void dispatch_words(const uint32_t* words)
+{
+	uint32_t w0 = words[0], w1 = words[1], w2 = words[2];
+	push([w0, w1, w2] { sink = w0 ^ w1 ^ w2; });
+}
+
+extern "C" void dispatch_pointer(void (*callback)(uint32_t), uint32_t arg)
+{
+	push([callback, arg] { callback(arg); });
+}
+
+extern "C" void dispatch_copy(uint32_t value)
+{
+	// A copy as well as the moves
+	Function function = [value] { sink = value * 3; };
+	Function copy = function;
+	push(std::move(copy));
+}
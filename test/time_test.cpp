@@ -0,0 +1,159 @@
+// MIT License
+
+// Copyright (c) 2019 Jacob Dahl
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Tests for the FTM0 time base. The multiply-shift conversions are checked against a
+// division for every tick count a read can produce. Time is then advanced through many
+// overflows and every read compared with the ticks actually elapsed. Last, the counter
+// is made to move on every read so that it wraps between the reads of one call while the
+// overflow interrupt is held off -- the time must still never go backwards.
+
+#include <timers/Time.hpp>
+
+extern "C" void ftm0_isr(void);
+
+static time::HighPrecisionTimer* timer(void)
+{
+	return time::HighPrecisionTimer::Instance();
+}
+
+static void test_conversions(void)
+{
+	for (uint64_t ticks = 0; ticks < 2 * FTM0_MAX_TICKS; ticks++)
+	{
+		assert(((ticks * TICKS_TO_US_MULT) >> TICKS_TO_US_SHIFT) == ticks / FTM0_TICKS_PER_MICRO);
+		assert(((ticks * TICKS_TO_NS_MULT) >> TICKS_TO_NS_SHIFT) == ticks * 1000 / FTM0_TICKS_PER_MICRO);
+	}
+}
+
+// Every unit agrees with the tick count read alongside it
+static void check_units(abs_time_t start_ticks, abs_time_t elapsed)
+{
+	abs_time_t ticks = timer()->get_absolute_time_ticks();
+	abs_time_t us = timer()->get_absolute_time_us();
+	abs_time_t ns = timer()->get_absolute_time_ns();
+
+	assert(ticks == start_ticks + elapsed);
+	assert(us == ticks / FTM0_TICKS_PER_MICRO);
+	assert(ns == ticks * 1000 / FTM0_TICKS_PER_MICRO);
+}
+
+static void test_overflows(void)
+{
+	std::mt19937 random(1);
+	std::uniform_int_distribution<uint32_t> steps(1, FTM0_MAX_TICKS + FTM0_MAX_TICKS / 2);
+
+	abs_time_t start = timer()->get_absolute_time_ticks();
+	abs_time_t elapsed = 0;
+
+	// Random steps, some shorter and some longer than a period
+	for (size_t i = 0; i < 20000; i++)
+	{
+		uint32_t step = steps(random);
+
+		host::advance_ticks(step);
+		elapsed += step;
+
+		check_units(start, elapsed);
+	}
+
+	// Landing exactly on and either side of the wrap
+	uint32_t counter = host::ftm0_read_counter();
+	host::advance_ticks(FTM0_MAX_TICKS - counter - 1);
+	elapsed += FTM0_MAX_TICKS - counter - 1;
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		check_units(start, elapsed);
+		host::advance_ticks(1);
+		elapsed++;
+	}
+
+	check_units(start, elapsed);
+}
+
+// The overflow ISR is not run while the counter wraps between reads. read_counter() must
+// take the pending TOF into account, or the time would jump back a whole period.
+static void test_overflow_between_reads(void)
+{
+	for (uint32_t step : { 1U, 7U, 59U, 600U, 4999U })
+	{
+		host::run_pending_isrs();
+
+		// Start just short of the wrap
+		uint32_t counter = host::ftm0_read_counter();
+		host::advance_ticks(FTM0_MAX_TICKS - counter - 2 * step - 1);
+
+		abs_time_t start_ticks = timer()->get_absolute_time_ticks();
+		abs_time_t previous_ticks = start_ticks;
+		abs_time_t previous_us = timer()->get_absolute_time_us();
+		abs_time_t previous_ns = timer()->get_absolute_time_ns();
+
+		host::ftm0_set_read_step(step);
+
+		// Well past the wrap, but not so far that the counter wraps a second time
+		size_t reads = (FTM0_MAX_TICKS / 2) / step / 3;
+
+		for (size_t i = 0; i < reads; i++)
+		{
+			abs_time_t ticks = timer()->get_absolute_time_ticks();
+			abs_time_t us = timer()->get_absolute_time_us();
+			abs_time_t ns = timer()->get_absolute_time_ns();
+
+			// One or two counter reads per call, each moves the counter on by step after
+			// it has been read
+			assert(ticks >= previous_ticks);
+			assert(ticks - previous_ticks <= 6 * step);
+			assert(us >= previous_us);
+			assert(ns > previous_ns || step * 1000 < FTM0_TICKS_PER_MICRO);
+
+			previous_ticks = ticks;
+			previous_us = us;
+			previous_ns = ns;
+		}
+
+		host::ftm0_set_read_step(0);
+
+		// The wrap did happen and the interrupt is still to come
+		assert(FTM0_SC & FTM_SC_TOF);
+		assert(previous_ticks > start_ticks + 2 * step);
+
+		abs_time_t before_isr = timer()->get_absolute_time_ticks();
+
+		ftm0_isr();
+
+		assert(!(FTM0_SC & FTM_SC_TOF));
+		assert(timer()->get_absolute_time_ticks() == before_isr);
+		assert(before_isr >= previous_ticks);
+	}
+}
+
+int main(void)
+{
+	time::HighPrecisionTimer::Instantiate();
+
+	test_conversions();
+	test_overflows();
+	test_overflow_between_reads();
+
+	printf("time_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+#
+# Generates the messenger topic structs from the .msg definitions in msg/
+#
+# Each .msg file holds one field per line: "<type>[<count>] <name>  # comment".
+# A "# TOPICS a b c" line makes the file define several topics with the same
+# fields, otherwise the topic is named after the file. Every topic <name>
+# becomes a struct <name>_s.
+#
+# Outputs (into --output):
+#   messages.hpp -- naturally aligned structs, constexpr field metadata and a
+#                   compact little endian serializer / deserializer per topic --
+#                   the shell's binary stream uses the serializer
+#   messages.py  -- host side decoder / encoder for the serialized form
+#
+# usage: generate_messages.py --output build/msg msg/*.msg
+
+import argparse
+import os
+import re
+import sys
+
+# idl type: (c++ type, size, python struct format, FieldType)
+TYPES = {
+    "bool":    ("bool",     1, "?", "BOOL"),
+    "uint8":   ("uint8_t",  1, "B", "UINT8"),
+    "int8":    ("int8_t",   1, "b", "INT8"),
+    "uint16":  ("uint16_t", 2, "H", "UINT16"),
+    "int16":   ("int16_t",  2, "h", "INT16"),
+    "uint32":  ("uint32_t", 4, "I", "UINT32"),
+    "int32":   ("int32_t",  4, "i", "INT32"),
+    "uint64":  ("uint64_t", 8, "Q", "UINT64"),
+    "int64":   ("int64_t",  8, "q", "INT64"),
+    "float32": ("float",    4, "f", "FLOAT32"),
+    "float64": ("double",   8, "d", "FLOAT64"),
+}
+
+FIELD_RE = re.compile(r"^(\w+)(?:\[(\d+)\])?\s+(\w+)\s*(?:#\s*(.*))?$")
+
+
+class Field(object):
+    def __init__(self, type_name, count, name, comment):
+        if type_name not in TYPES:
+            raise ValueError("unknown type '%s'" % type_name)
+
+        self.type_name = type_name
+        self.count = count
+        self.name = name
+        self.comment = comment
+
+        self.cpp_type, self.size, self.fmt, self.field_type = TYPES[type_name]
+
+    @property
+    def total_size(self):
+        return self.size * max(self.count, 1)
+
+
+class Message(object):
+    def __init__(self, path):
+        self.fields = []
+        self.description = []
+        self.topics = []
+
+        base = os.path.splitext(os.path.basename(path))[0]
+
+        with open(path) as f:
+            for number, line in enumerate(f, 1):
+                line = line.strip()
+
+                if not line:
+                    continue
+
+                if line.startswith("#"):
+                    text = line[1:].strip()
+                    if text.startswith("TOPICS"):
+                        self.topics += text.split()[1:]
+                    elif not self.fields:
+                        self.description.append(text)
+                    continue
+
+                match = FIELD_RE.match(line)
+                if match is None:
+                    raise ValueError("%s:%d: can not parse '%s'" % (path, number, line))
+
+                type_name, count, name, comment = match.groups()
+                self.fields.append(Field(type_name, int(count or 0), name, comment))
+
+        if not self.topics:
+            self.topics = [base]
+
+    # Largest members first so the compiler never has to pad between them
+    def aligned_fields(self):
+        return sorted(self.fields, key=lambda f: f.size, reverse=True)
+
+    def serialized_size(self):
+        return sum(f.total_size for f in self.fields)
+
+
+def generate_header(messages):
+    out = []
+    out.append("// Generated by tools/msg_gen/generate_messages.py -- DO NOT EDIT")
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append("#include <stdint.h>")
+    out.append("#include <stddef.h>")
+    out.append("#include <string.h>")
+    out.append("")
+    out.append("// NOTE: the serialized form is the fields in .msg order, tightly packed and little")
+    out.append("// endian -- the native byte order of both the Cortex-M4 and the host.")
+    out.append("")
+    out.append("namespace messages")
+    out.append("{")
+    out.append("")
+    out.append("enum class FieldType : uint8_t")
+    out.append("{")
+    for t in sorted(set(v[3] for v in TYPES.values())):
+        out.append("\t%s," % t)
+    out.append("};")
+    out.append("")
+    out.append("struct FieldInfo")
+    out.append("{")
+    out.append("\tconst char* name;")
+    out.append("\tFieldType type;")
+    out.append("\tuint16_t count; // 0 for scalars")
+    out.append("\tuint16_t offset; // in the struct")
+    out.append("};")
+    out.append("")
+    out.append("template <typename T>")
+    out.append("struct message_metadata;")
+    out.append("")
+    out.append("} // end namespace messages")
+
+    for msg in messages:
+        for topic in msg.topics:
+            struct = topic + "_s"
+
+            out.append("")
+            for line in msg.description:
+                out.append("// " + line)
+            out.append("struct %s" % struct)
+            out.append("{")
+            for f in msg.aligned_fields():
+                decl = "\t%s %s%s;" % (f.cpp_type, f.name, "[%d]" % f.count if f.count else "")
+                if f.comment:
+                    decl += " // " + f.comment
+                out.append(decl)
+            out.append("};")
+
+            out.append("")
+            out.append("namespace messages")
+            out.append("{")
+            out.append("")
+            out.append("static constexpr FieldInfo %s_fields[] =" % topic)
+            out.append("{")
+            for f in msg.fields:
+                out.append("\t{ \"%s\", FieldType::%s, %d, offsetof(%s, %s) }," % (f.name, f.field_type, f.count, struct, f.name))
+            out.append("};")
+            out.append("")
+            out.append("template <>")
+            out.append("struct message_metadata<%s>" % struct)
+            out.append("{")
+            out.append("\tstatic constexpr const char* name(void) { return \"%s\"; };" % topic)
+            out.append("\tstatic constexpr const FieldInfo* fields(void) { return %s_fields; };" % topic)
+            out.append("\tstatic constexpr size_t field_count = %d;" % len(msg.fields))
+            out.append("\tstatic constexpr size_t serialized_size = %d;" % msg.serialized_size())
+            out.append("};")
+            out.append("")
+            out.append("inline size_t serialize(const %s& msg, uint8_t* buffer)" % struct)
+            out.append("{")
+            offset = 0
+            for f in msg.fields:
+                out.append("\tmemcpy(buffer + %d, &msg.%s, %d);" % (offset, f.name, f.total_size))
+                offset += f.total_size
+            out.append("\treturn %d;" % offset)
+            out.append("}")
+            out.append("")
+            out.append("inline size_t deserialize(%s& msg, const uint8_t* buffer)" % struct)
+            out.append("{")
+            offset = 0
+            for f in msg.fields:
+                out.append("\tmemcpy(&msg.%s, buffer + %d, %d);" % (f.name, offset, f.total_size))
+                offset += f.total_size
+            out.append("\treturn %d;" % offset)
+            out.append("}")
+            out.append("")
+            out.append("} // end namespace messages")
+
+    out.append("")
+    return "\n".join(out)
+
+
+def generate_decoder(messages):
+    out = []
+    out.append("# Generated by tools/msg_gen/generate_messages.py -- DO NOT EDIT")
+    out.append("#")
+    out.append("# Decodes the serialized form produced by messages::serialize() on the target, and")
+    out.append("# encodes it for messages::deserialize().")
+    out.append("")
+    out.append("import struct")
+    out.append("")
+    out.append("# topic: (struct format, [(field, count), ...])")
+    out.append("MESSAGES = {")
+    for msg in messages:
+        fmt = "<" + "".join(("%d%s" % (f.count, f.fmt)) if f.count else f.fmt for f in msg.fields)
+        fields = ", ".join("(\"%s\", %d)" % (f.name, f.count) for f in msg.fields)
+        for topic in msg.topics:
+            out.append("    \"%s\": (\"%s\", [%s])," % (topic, fmt, fields))
+    out.append("}")
+    out.append("")
+    out.append("")
+    out.append("def serialized_size(topic):")
+    out.append("    return struct.calcsize(MESSAGES[topic][0])")
+    out.append("")
+    out.append("")
+    out.append("def decode(topic, data):")
+    out.append("    fmt, fields = MESSAGES[topic]")
+    out.append("    values = list(struct.unpack_from(fmt, data))")
+    out.append("    result = {}")
+    out.append("    for name, count in fields:")
+    out.append("        if count:")
+    out.append("            result[name] = tuple(values[:count])")
+    out.append("            del values[:count]")
+    out.append("        else:")
+    out.append("            result[name] = values.pop(0)")
+    out.append("    return result")
+    out.append("")
+    out.append("")
+    out.append("def encode(topic, values):")
+    out.append("    fmt, fields = MESSAGES[topic]")
+    out.append("    flat = []")
+    out.append("    for name, count in fields:")
+    out.append("        if count:")
+    out.append("            flat.extend(values[name])")
+    out.append("        else:")
+    out.append("            flat.append(values[name])")
+    out.append("    return struct.pack(fmt, *flat)")
+    out.append("")
+    return "\n".join(out)
+
+
+def write_if_changed(path, content):
+    # Keep the timestamp (and make's dependency graph) stable if nothing changed
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == content:
+                return
+
+    with open(path, "w") as f:
+        f.write(content)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate messenger structs from .msg files")
+    parser.add_argument("--output", required=True, help="output directory")
+    parser.add_argument("files", nargs="+", help=".msg files")
+    args = parser.parse_args()
+
+    try:
+        messages = [Message(path) for path in sorted(args.files)]
+    except ValueError as e:
+        sys.stderr.write("generate_messages: %s\n" % e)
+        return 1
+
+    if not os.path.isdir(args.output):
+        os.makedirs(args.output)
+
+    write_if_changed(os.path.join(args.output, "messages.hpp"), generate_header(messages))
+    write_if_changed(os.path.join(args.output, "messages.py"), generate_decoder(messages))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
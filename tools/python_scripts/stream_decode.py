@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+#
+# Prints a topic streamed with the shell's "stream bin <topic>" command as CSV.
+#
+# Frame: 0xA5 0x5A, payload length, payload, 8 bit sum of the payload. The payload is
+# decoded with build/msg/messages.py, generated from msg/ along with the firmware.
+#
+# usage: stream_decode.py accel_raw_data /dev/ttyUSB0
+#        stream_decode.py accel_raw_data capture.bin
+
+import argparse
+import os
+import stat
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "build", "msg"))
+
+import messages
+
+SYNC = b"\xa5\x5a"
+BAUD = 460800
+
+
+def open_input(path, baud):
+    if stat.S_ISREG(os.stat(path).st_mode):
+        return open(path, "rb")
+
+    import serial
+    return serial.Serial(path, baud)
+
+
+def frames(stream, size):
+    buffer = b""
+
+    while True:
+        data = stream.read(1 if not buffer else max(1, len(SYNC) + size + 2 - len(buffer)))
+        if not data:
+            return
+        buffer += data
+
+        start = buffer.find(SYNC)
+        if start < 0:
+            buffer = buffer[-1:]
+            continue
+        buffer = buffer[start:]
+
+        if len(buffer) < len(SYNC) + 1 + size + 1:
+            continue
+
+        length = buffer[len(SYNC)]
+        payload = buffer[len(SYNC) + 1:len(SYNC) + 1 + size]
+        checksum = buffer[len(SYNC) + 1 + size]
+
+        # Not a frame after all, look for the next sync
+        if length != size or sum(payload) & 0xFF != checksum:
+            buffer = buffer[1:]
+            continue
+
+        buffer = buffer[len(SYNC) + 1 + size + 1:]
+        yield payload
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a binary topic stream to CSV")
+    parser.add_argument("topic", help="topic name as in msg/, e.g. accel_raw_data")
+    parser.add_argument("port", help="serial port or a file captured from it")
+    parser.add_argument("--baud", type=int, default=BAUD)
+    args = parser.parse_args()
+
+    if args.topic not in messages.MESSAGES:
+        sys.stderr.write("unknown topic '%s', one of: %s\n" % (args.topic, " ".join(sorted(messages.MESSAGES))))
+        return 1
+
+    size = messages.serialized_size(args.topic)
+    fields = messages.MESSAGES[args.topic][1]
+
+    header = []
+    for name, count in fields:
+        header += ["%s[%d]" % (name, i) for i in range(count)] if count else [name]
+    print(",".join(header))
+
+    with open_input(args.port, args.baud) as stream:
+        for payload in frames(stream, size):
+            sample = messages.decode(args.topic, payload)
+            row = []
+            for name, count in fields:
+                row += [str(v) for v in sample[name]] if count else [str(sample[name])]
+            print(",".join(row))
+            sys.stdout.flush()
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())